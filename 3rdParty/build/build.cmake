@@ -9,4 +9,5 @@ find_package(imgui CONFIG REQUIRED)
 find_package(Opus CONFIG REQUIRED)
 find_path(DRLIBS_INCLUDE_DIRS "dr_flac.h")
 find_path(SPEEXDSP_INCLUDE_DIRS "speex/speex_resampler.h")
+find_library(SPEEXDSP_LIBRARY NAMES speexdsp libspeexdsp REQUIRED)
 include (${CMAKE_CURRENT_SOURCE_DIR}/3rdParty/libopusenc/build/build.cmake)
\ No newline at end of file
@@ -1214,7 +1214,7 @@ EXPORT int speex_resampler_reset_mem(SpeexResamplerState *st)
       st->magic_samples[i] = 0;
       st->samp_frac_num[i] = 0;
    }
-   for (i=0;i<st->nb_channels*(st->filt_len-1);i++)
+   for (i=0;i<st->nb_channels*st->mem_alloc_size;i++)
       st->mem[i] = 0;
    return RESAMPLER_ERR_SUCCESS;
 }
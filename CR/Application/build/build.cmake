@@ -5,10 +5,18 @@ set(CR_INTERFACE_HEADERS
 )
 
 set(CR_INTERFACE_MODULES
+  ${root}/interface/DirectoryWalker.ixx
+  ${root}/interface/Downmix.ixx
+  ${root}/interface/OggOpus.ixx
+  ${root}/interface/SyncManifest.ixx
 )
 
 set(CR_IMPLEMENTATION
+  ${root}/implementation/DirectoryWalker.cxx
+  ${root}/implementation/Downmix.cxx
   ${root}/implementation/main.cpp
+  ${root}/implementation/OggOpus.cxx
+  ${root}/implementation/SyncManifest.cxx
 )
 
 set(CR_BUILD_FILES
@@ -28,8 +36,14 @@ target_link_libraries(MusicConverter PRIVATE
   glad::glad
   imgui::imgui
   SampleRate::samplerate
+  ${SPEEXDSP_LIBRARY}
   engine
 )
-target_include_directories(MusicConverter PRIVATE ${DRLIBS_INCLUDE_DIRS})
+target_include_directories(MusicConverter PRIVATE ${DRLIBS_INCLUDE_DIRS} ${SPEEXDSP_INCLUDE_DIRS})
+
+# ogg packer and header writer from libopusenc, for stitching together segments that were encoded
+# in parallel. They aren't part of its public api, so only the file that wraps them can see them.
+set_source_files_properties(${root}/implementation/OggOpus.cxx PROPERTIES
+  INCLUDE_DIRECTORIES "${CMAKE_SOURCE_DIR}/3rdParty/libopusenc/libopusenc/src")
 
 endblock()
\ No newline at end of file
@@ -0,0 +1,111 @@
+module;
+
+module CR.Application.DirectoryWalker;
+
+import std;
+
+namespace cea = CR::Application;
+namespace fs  = std::filesystem;
+
+using namespace std::literals;
+
+namespace {
+	struct QueuedDirectory {
+		fs::path path;
+		// relative to the root of the walk, empty for the root itself.
+		fs::path relPath;
+	};
+
+	struct WalkQueue {
+		std::mutex mutex;
+		std::deque<QueuedDirectory> directories;
+	};
+
+	struct WalkState {
+		WalkState(uint32_t a_numThreads) : queues(a_numThreads) {}
+
+		std::vector<WalkQueue> queues;
+		// directories queued or being listed, the walk is done when this hits 0.
+		std::atomic_uint64_t pending{};
+		std::atomic_bool failed{};
+		std::mutex errorMutex;
+		std::optional<cea::WalkError> error;
+	};
+
+	// Own queue is used as a stack so a thread stays in the part of the tree it was just in, thieves
+	// take from the other end, which is the oldest and usually the biggest subtree.
+	std::optional<QueuedDirectory> NextDirectory(WalkState& a_state, uint32_t a_thread) {
+		{
+			WalkQueue& queue = a_state.queues[a_thread];
+			std::scoped_lock lock(queue.mutex);
+			if(!queue.directories.empty()) {
+				QueuedDirectory directory = std::move(queue.directories.back());
+				queue.directories.pop_back();
+				return directory;
+			}
+		}
+		const auto numThreads = (uint32_t)a_state.queues.size();
+		for(uint32_t i = 1; i < numThreads; ++i) {
+			WalkQueue& queue = a_state.queues[(a_thread + i) % numThreads];
+			std::scoped_lock lock(queue.mutex);
+			if(!queue.directories.empty()) {
+				QueuedDirectory directory = std::move(queue.directories.front());
+				queue.directories.pop_front();
+				return directory;
+			}
+		}
+		return std::nullopt;
+	}
+
+	void WalkThread(WalkState& a_state, uint32_t a_thread, const cea::WalkVisitor& a_visitor) {
+		while(!a_state.failed.load()) {
+			std::optional<QueuedDirectory> directory = NextDirectory(a_state, a_thread);
+			if(!directory) {
+				if(a_state.pending.load() == 0) { return; }
+				// someone is still listing a directory, it may have more work soon.
+				std::this_thread::sleep_for(1ms);
+				continue;
+			}
+
+			std::error_code ec;
+			fs::directory_iterator iterator(directory->path, ec);
+			for(; !ec && iterator != fs::directory_iterator{}; iterator.increment(ec)) {
+				const fs::directory_entry& entry = *iterator;
+				fs::path relPath                 = directory->relPath / entry.path().filename();
+				a_visitor(a_thread, entry, relPath);
+				std::error_code typeError;
+				if(!entry.is_directory(typeError) || entry.is_symlink(typeError) || typeError) {
+					continue;
+				}
+				++a_state.pending;
+				WalkQueue& queue = a_state.queues[a_thread];
+				std::scoped_lock lock(queue.mutex);
+				queue.directories.emplace_back(entry.path(), std::move(relPath));
+			}
+			if(ec) {
+				std::scoped_lock lock(a_state.errorMutex);
+				if(!a_state.error) { a_state.error = cea::WalkError{directory->path, ec}; }
+				a_state.failed.store(true);
+			}
+			--a_state.pending;
+		}
+	}
+}    // namespace
+
+std::optional<cea::WalkError> cea::WalkDirectory(const fs::path& a_root, uint32_t a_numThreads,
+                                                 const WalkVisitor& a_visitor) {
+	a_numThreads = std::max(a_numThreads, 1u);
+
+	WalkState state(a_numThreads);
+	state.queues[0].directories.emplace_back(a_root, fs::path{});
+	state.pending = 1;
+	{
+		std::vector<std::jthread> threads;
+		threads.reserve(a_numThreads - 1);
+		for(uint32_t i = 1; i < a_numThreads; ++i) {
+			threads.emplace_back([&state, i, &a_visitor]() { WalkThread(state, i, a_visitor); });
+		}
+		WalkThread(state, 0, a_visitor);
+	}
+	return state.error;
+}
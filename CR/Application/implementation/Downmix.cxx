@@ -0,0 +1,338 @@
+module;
+
+#include <core/Log.hpp>
+
+#include <fmt/format.h>
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+module CR.Application.Downmix;
+
+import std;
+
+namespace cea = CR::Application;
+
+// MSVC lets any intrinsic be used anywhere, gcc and clang need the function to be marked with the
+// instruction set it uses so it can live in a TU that isn't built for that cpu.
+#if defined(_MSC_VER)
+#define CR_TARGET_SSE3
+#define CR_TARGET_AVX2
+#else
+#define CR_TARGET_SSE3 __attribute__((target("sse3")))
+#define CR_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace {
+	// flac says by default channel layout is
+	// 1 channel - mono
+	// 2 channel - left, right
+	// 3 channel - left, right, center
+	// 4 channel - left, right, back left, back right
+	// 5 channel - left, right, center, back left, back right
+	// 6 channel - left, right, center, LFE, back left, back right
+	// 7 channel - left, right, center, LFE, back center, back left, back right
+	// 8 channel - left, right, center, LFE, back left, back right, side left, side right
+	// mostly just following suggestion in
+	// https://www.atsc.org/wp-content/uploads/2015/03/A52-201212-17.pdf to merge
+	// I don't have sdev and cdev, so just going to mix center at -3db and rears at -6db, LFE at
+	// identity. Each output is then normalized so the weights feeding it sum to 1.
+	enum class Speaker {
+		Mono,
+		Left,
+		Right,
+		Center,
+		Lfe,
+		BackCenter,
+		BackLeft,
+		BackRight,
+		SideLeft,
+		SideRight
+	};
+
+	constexpr float c_mainMix   = 1.0f;
+	constexpr float c_centerMix = 0.707f;
+	constexpr float c_lfeMix    = 1.0f;
+	constexpr float c_rearMix   = 0.5f;
+
+	// Q15 fixed point for the integer downmix
+	constexpr int32_t c_fixedShift = 15;
+	constexpr float c_fixedOne     = (float)(1 << c_fixedShift);
+
+	constexpr std::pair<float, float> SpeakerMix(Speaker a_speaker) {
+		switch(a_speaker) {
+			case Speaker::Mono:
+				return {c_mainMix, c_mainMix};
+			case Speaker::Left:
+				return {c_mainMix, 0.0f};
+			case Speaker::Right:
+				return {0.0f, c_mainMix};
+			case Speaker::Center:
+				return {c_centerMix, c_centerMix};
+			case Speaker::Lfe:
+				return {c_lfeMix, c_lfeMix};
+			case Speaker::BackCenter:
+				return {c_rearMix, c_rearMix};
+			case Speaker::BackLeft:
+			case Speaker::SideLeft:
+				return {c_rearMix, 0.0f};
+			case Speaker::BackRight:
+			case Speaker::SideRight:
+				return {0.0f, c_rearMix};
+		}
+		return {0.0f, 0.0f};
+	}
+
+	constexpr cea::DownmixMatrix BuildMatrix(std::initializer_list<Speaker> a_layout) {
+		cea::DownmixMatrix matrix;
+		matrix.NumChannels = (uint32_t)a_layout.size();
+		float leftTotal    = 0.0f;
+		float rightTotal   = 0.0f;
+		uint32_t channel   = 0;
+		for(Speaker speaker : a_layout) {
+			auto [left, right]    = SpeakerMix(speaker);
+			matrix.Left[channel]  = left;
+			matrix.Right[channel] = right;
+			leftTotal += left;
+			rightTotal += right;
+			++channel;
+		}
+		for(uint32_t i = 0; i < matrix.NumChannels; ++i) {
+			matrix.Left[i] /= leftTotal;
+			matrix.Right[i] /= rightTotal;
+			matrix.LeftFixed[i]  = (int32_t)(matrix.Left[i] * c_fixedOne + 0.5f);
+			matrix.RightFixed[i] = (int32_t)(matrix.Right[i] * c_fixedOne + 0.5f);
+		}
+		return matrix;
+	}
+
+	using enum Speaker;
+	// indexed by number of channels, 0 is unused.
+	constexpr std::array c_downmixMatrices{
+	    cea::DownmixMatrix{},
+	    BuildMatrix({Mono}),
+	    BuildMatrix({Left, Right}),
+	    BuildMatrix({Left, Right, Center}),
+	    BuildMatrix({Left, Right, BackLeft, BackRight}),
+	    BuildMatrix({Left, Right, Center, BackLeft, BackRight}),
+	    BuildMatrix({Left, Right, Center, Lfe, BackLeft, BackRight}),
+	    BuildMatrix({Left, Right, Center, Lfe, BackCenter, BackLeft, BackRight}),
+	    BuildMatrix({Left, Right, Center, Lfe, BackLeft, BackRight, SideLeft, SideRight}),
+	};
+	static_assert(c_downmixMatrices.size() == cea::c_maxDownmixChannels + 1);
+
+	void DownmixScalar(const cea::DownmixMatrix& a_matrix, const float* a_src, float* a_dest,
+	                   uint32_t a_startFrame, uint32_t a_numFrames) {
+		const uint32_t numChannels = a_matrix.NumChannels;
+		for(uint32_t frame = a_startFrame; frame < a_numFrames; ++frame) {
+			const float* srcFrame = a_src + frame * numChannels;
+			float left            = 0.0f;
+			float right           = 0.0f;
+			for(uint32_t channel = 0; channel < numChannels; ++channel) {
+				left += a_matrix.Left[channel] * srcFrame[channel];
+				right += a_matrix.Right[channel] * srcFrame[channel];
+			}
+			a_dest[2 * frame + 0] = left;
+			a_dest[2 * frame + 1] = right;
+		}
+	}
+
+	// The SIMD kernels load a whole frame into one register, 8 lanes for avx2, 2x4 lanes for sse,
+	// and rely on the 0 weights to ignore lanes that belong to the next frame. Those loads run past
+	// the end of a frame, so the last few frames, where that would read past the end of a_src, are
+	// left for the scalar kernel. Two frames are reduced together, so the horizontal adds produce
+	// left/right/left/right ready to store.
+
+	// Number of frames, from the start, whose wide load of a_loadWidth floats stays inside a_src
+	uint32_t SafeSimdFrames(uint32_t a_numChannels, uint32_t a_numFrames, uint32_t a_loadWidth) {
+		const uint64_t totalSamples = (uint64_t)a_numChannels * a_numFrames;
+		if(totalSamples < a_loadWidth) { return 0; }
+		return (uint32_t)((totalSamples - a_loadWidth) / a_numChannels + 1);
+	}
+
+	CR_TARGET_SSE3 void DownmixSse3(const cea::DownmixMatrix& a_matrix, const float* a_src,
+	                                float* a_dest, uint32_t a_numFrames) {
+		const uint32_t numChannels = a_matrix.NumChannels;
+		const __m128 leftLow       = _mm_loadu_ps(a_matrix.Left.data());
+		const __m128 leftHigh      = _mm_loadu_ps(a_matrix.Left.data() + 4);
+		const __m128 rightLow      = _mm_loadu_ps(a_matrix.Right.data());
+		const __m128 rightHigh     = _mm_loadu_ps(a_matrix.Right.data() + 4);
+
+		auto mixFrame = [&](const float* a_frame, __m128& a_left, __m128& a_right) {
+			__m128 low  = _mm_loadu_ps(a_frame);
+			__m128 high = _mm_loadu_ps(a_frame + 4);
+			a_left      = _mm_add_ps(_mm_mul_ps(low, leftLow), _mm_mul_ps(high, leftHigh));
+			a_right     = _mm_add_ps(_mm_mul_ps(low, rightLow), _mm_mul_ps(high, rightHigh));
+		};
+
+		const uint32_t simdFrames = SafeSimdFrames(numChannels, a_numFrames, 8) & ~1u;
+		uint32_t frame            = 0;
+		for(; frame < simdFrames; frame += 2) {
+			__m128 left0, right0, left1, right1;
+			mixFrame(a_src + frame * numChannels, left0, right0);
+			mixFrame(a_src + (frame + 1) * numChannels, left1, right1);
+			// l0 l0 r0 r0, l1 l1 r1 r1 -> l0 r0 l1 r1
+			__m128 sum0 = _mm_hadd_ps(left0, right0);
+			__m128 sum1 = _mm_hadd_ps(left1, right1);
+			_mm_storeu_ps(a_dest + 2 * frame, _mm_hadd_ps(sum0, sum1));
+		}
+		DownmixScalar(a_matrix, a_src, a_dest, frame, a_numFrames);
+	}
+
+	CR_TARGET_AVX2 void DownmixAvx2(const cea::DownmixMatrix& a_matrix, const float* a_src,
+	                                float* a_dest, uint32_t a_numFrames) {
+		const uint32_t numChannels = a_matrix.NumChannels;
+		const __m256 leftWeights   = _mm256_loadu_ps(a_matrix.Left.data());
+		const __m256 rightWeights  = _mm256_loadu_ps(a_matrix.Right.data());
+
+		const uint32_t simdFrames = SafeSimdFrames(numChannels, a_numFrames, 8) & ~1u;
+		uint32_t frame            = 0;
+		for(; frame < simdFrames; frame += 2) {
+			__m256 frame0 = _mm256_loadu_ps(a_src + frame * numChannels);
+			__m256 frame1 = _mm256_loadu_ps(a_src + (frame + 1) * numChannels);
+			// 4 partial sums per output in each 128 bit lane after the first two hadds, the last
+			// add folds the upper lane onto the lower one.
+			__m256 sum0 = _mm256_hadd_ps(_mm256_mul_ps(frame0, leftWeights),
+			                             _mm256_mul_ps(frame0, rightWeights));
+			__m256 sum1 = _mm256_hadd_ps(_mm256_mul_ps(frame1, leftWeights),
+			                             _mm256_mul_ps(frame1, rightWeights));
+			__m256 sum  = _mm256_hadd_ps(sum0, sum1);
+			__m128 result = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+			_mm_storeu_ps(a_dest + 2 * frame, result);
+		}
+		DownmixScalar(a_matrix, a_src, a_dest, frame, a_numFrames);
+	}
+
+	void DownmixScalarKernel(const cea::DownmixMatrix& a_matrix, const float* a_src, float* a_dest,
+	                         uint32_t a_numFrames) {
+		DownmixScalar(a_matrix, a_src, a_dest, 0, a_numFrames);
+	}
+
+	struct DownmixKernel {
+		void (*Function)(const cea::DownmixMatrix&, const float*, float*, uint32_t){};
+		const char* Name{};
+	};
+
+	bool CpuSupportsAvx2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7) { return false; }
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool fma     = (info[2] & (1 << 12)) != 0;
+		if(!osxsave || !fma) { return false; }
+		// OS has to be saving the ymm registers on context switch
+		if((_xgetbv(0) & 0x6) != 0x6) { return false; }
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+
+	bool CpuSupportsSse3() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & 1) != 0;
+#else
+		return __builtin_cpu_supports("sse3");
+#endif
+	}
+
+	const DownmixKernel& GetKernel() {
+		static const DownmixKernel kernel = []() -> DownmixKernel {
+			if(CpuSupportsAvx2()) { return {DownmixAvx2, "avx2"}; }
+			if(CpuSupportsSse3()) { return {DownmixSse3, "sse3"}; }
+			return {DownmixScalarKernel, "scalar"};
+		}();
+		return kernel;
+	}
+}    // namespace
+
+const cea::DownmixMatrix* cea::GetDownmixMatrix(uint32_t a_numChannels) {
+	if(a_numChannels == 0 || a_numChannels > c_maxDownmixChannels) { return nullptr; }
+	return &c_downmixMatrices[a_numChannels];
+}
+
+void cea::Downmix(const DownmixMatrix& a_matrix, const float* a_src, float* a_dest,
+                  uint32_t a_numFrames) {
+	GetKernel().Function(a_matrix, a_src, a_dest, a_numFrames);
+
+#if CR_DEBUG
+	// SIMD kernels sum in a different order, so only expect a match to within float rounding.
+	for(uint32_t frame = 0; frame < a_numFrames; ++frame) {
+		float expected[2];
+		DownmixScalar(a_matrix, a_src + frame * a_matrix.NumChannels, expected, 0, 1);
+		CR_ASSERT(std::abs(expected[0] - a_dest[2 * frame + 0]) <= 1e-5f &&
+		              std::abs(expected[1] - a_dest[2 * frame + 1]) <= 1e-5f,
+		          "{} downmix kernel doesn't match scalar at frame {}", GetKernel().Name, frame);
+	}
+#endif
+}
+
+void cea::Downmix(const DownmixMatrix& a_matrix, const int16_t* a_src, int16_t* a_dest,
+                  uint32_t a_numFrames) {
+	// plain loop, the compiler vectorizes this well enough, and the 16 bit path is only used when
+	// there is no resample so the downmix isn't the bottleneck anyway.
+	const uint32_t numChannels = a_matrix.NumChannels;
+	constexpr int32_t rounding = 1 << (c_fixedShift - 1);
+	for(uint32_t frame = 0; frame < a_numFrames; ++frame) {
+		const int16_t* srcFrame = a_src + frame * numChannels;
+		int32_t left            = rounding;
+		int32_t right           = rounding;
+		for(uint32_t channel = 0; channel < numChannels; ++channel) {
+			left += a_matrix.LeftFixed[channel] * srcFrame[channel];
+			right += a_matrix.RightFixed[channel] * srcFrame[channel];
+		}
+		a_dest[2 * frame + 0] = (int16_t)std::clamp(left >> c_fixedShift, -32768, 32767);
+		a_dest[2 * frame + 1] = (int16_t)std::clamp(right >> c_fixedShift, -32768, 32767);
+	}
+}
+
+const char* cea::GetDownmixKernelName() {
+	return GetKernel().Name;
+}
+
+bool cea::CheckDownmixKernels(std::string& a_log) {
+	// SIMD kernels sum in a different order, inputs are in [-1, 1] and the weights for each output
+	// sum to 1, so this is a few ulp of the largest possible output.
+	constexpr float c_tolerance = 1e-5f;
+	// short counts are all tail, the longer ones have both a SIMD body and a tail.
+	constexpr std::array c_frameCounts{0u, 1u, 2u, 3u, 4u, 5u, 7u, 8u, 9u, 16u, 33u, 4096u, 4099u};
+
+	std::vector<DownmixKernel> kernels;
+	if(CpuSupportsSse3()) { kernels.push_back({DownmixSse3, "sse3"}); }
+	if(CpuSupportsAvx2()) { kernels.push_back({DownmixAvx2, "avx2"}); }
+	if(kernels.empty()) { a_log += "no SIMD kernels on this cpu, only scalar\n"; }
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+	bool passed = true;
+	for(const DownmixKernel& kernel : kernels) {
+		for(uint32_t numChannels = 1; numChannels <= c_maxDownmixChannels; ++numChannels) {
+			const DownmixMatrix& matrix = *GetDownmixMatrix(numChannels);
+			float maxError              = 0.0f;
+			for(uint32_t numFrames : c_frameCounts) {
+				// exact size, so a load past the end would be caught by a debug heap or asan.
+				std::vector<float> src(numFrames * numChannels);
+				for(float& value : src) { value = sample(random); }
+				std::vector<float> expected(numFrames * 2);
+				std::vector<float> result(numFrames * 2);
+				DownmixScalar(matrix, src.data(), expected.data(), 0, numFrames);
+				kernel.Function(matrix, src.data(), result.data(), numFrames);
+				for(size_t i = 0; i < expected.size(); ++i) {
+					maxError = std::max(maxError, std::abs(expected[i] - result[i]));
+				}
+			}
+			const bool ok = maxError <= c_tolerance;
+			a_log += fmt::format("{:<6} {} channels max error {:.2e} {}\n", kernel.Name, numChannels,
+			                     maxError, ok ? "ok" : "WRONG");
+			passed = passed && ok;
+		}
+	}
+	return passed;
+}
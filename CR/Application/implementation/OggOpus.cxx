@@ -0,0 +1,101 @@
+module;
+
+#include <fmt/format.h>
+
+#include <opusenc.h>
+
+// libopusenc internals, only this file sees them.
+#include <ogg_packer.h>
+extern "C" {
+#include <opus_header.h>
+}
+
+module CR.Application.OggOpus;
+
+import CR.Engine;
+
+import std;
+
+namespace cecore = CR::Engine::Core;
+namespace cea    = CR::Application;
+
+namespace CR::Application {
+	struct OggPackerData {
+		oggpacker* m_packer{nullptr};
+	};
+}    // namespace CR::Application
+
+cea::OggPacker::OggPacker(uint32_t a_serial) {
+	m_data           = std::make_unique<OggPackerData>();
+	m_data->m_packer = oggp_create((oggp_int32)a_serial);
+}
+
+cea::OggPacker::~OggPacker() {
+	if(m_data->m_packer) { oggp_destroy(m_data->m_packer); }
+}
+
+bool cea::OggPacker::isValid() const {
+	return m_data->m_packer != nullptr;
+}
+
+void cea::OggPacker::SetMuxingDelay(uint64_t a_delay) {
+	oggp_set_muxing_delay(m_data->m_packer, a_delay);
+}
+
+bool cea::OggPacker::AddPacket(std::span<const unsigned char> a_packet, uint64_t a_granule,
+                               bool a_endOfStream) {
+	unsigned char* packet = oggp_get_packet_buffer(m_data->m_packer, (oggp_int32)a_packet.size());
+	if(packet == nullptr) { return false; }
+	std::memcpy(packet, a_packet.data(), a_packet.size());
+	return oggp_commit_packet(m_data->m_packer, (oggp_int32)a_packet.size(), a_granule,
+	                          a_endOfStream ? 1 : 0) == 0;
+}
+
+void cea::OggPacker::Flush() {
+	oggp_flush_page(m_data->m_packer);
+}
+
+bool cea::OggPacker::NextPage(std::span<const unsigned char>& a_page) {
+	unsigned char* page{};
+	oggp_int32 pageSize{};
+	if(!oggp_get_next_page(m_data->m_packer, &page, &pageSize)) { return false; }
+	a_page = {page, (size_t)pageSize};
+	return true;
+}
+
+std::vector<unsigned char> cea::BuildOpusHead(int32_t a_channels, int32_t a_preskip,
+                                              uint32_t a_inputSampleRate) {
+	if(a_channels != 1 && a_channels != 2) { return {}; }
+	OpusHeader header{};
+	header.channels          = a_channels;
+	header.preskip           = a_preskip;
+	header.input_sample_rate = a_inputSampleRate;
+	header.gain              = 0;
+	header.channel_mapping   = 0;
+	std::vector<unsigned char> packet((size_t)opeint_opus_header_get_size(&header));
+	int32_t packetSize =
+	    opeint_opus_header_to_packet(&header, packet.data(), (int32_t)packet.size(), nullptr);
+	packet.resize((size_t)packetSize);
+	return packet;
+}
+
+std::vector<unsigned char> cea::BuildOpusTags(const std::vector<std::string>& a_comments,
+                                              int32_t a_padding) {
+	char* comments{};
+	int32_t commentsLength{};
+	auto vendor = fmt::format("{}, {}", opus_get_version_string(), ope_get_version_string());
+	opeint_comment_init(&comments, &commentsLength, vendor.c_str());
+	if(comments == nullptr) { return {}; }
+	auto freeComments = cecore::defer([&] { std::free(comments); });
+	for(const auto& comment : a_comments) {
+		if(comment.find('=') == std::string::npos) { continue; }
+		if(opeint_comment_add(&comments, &commentsLength, nullptr, comment.c_str()) != 0) {
+			return {};
+		}
+	}
+	// pad leaves the packet as it was if it runs out of memory.
+	const int32_t unpaddedLength = commentsLength;
+	opeint_comment_pad(&comments, &commentsLength, a_padding);
+	if(a_padding > 0 && commentsLength - unpaddedLength < a_padding) { return {}; }
+	return {comments, comments + commentsLength};
+}
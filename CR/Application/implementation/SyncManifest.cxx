@@ -0,0 +1,225 @@
+module CR.Application.SyncManifest;
+
+import CR.Engine;
+
+import std;
+
+namespace cecore = CR::Engine::Core;
+namespace cep    = CR::Engine::Platform;
+namespace cea    = CR::Application;
+namespace fs     = std::filesystem;
+
+namespace {
+	constexpr uint64_t c_manifestMagic   = cecore::EightCC("CRSYNCMF");
+	constexpr uint32_t c_manifestVersion = 1;
+	constexpr uint64_t c_journalMagic    = cecore::EightCC("CRSYNCJL");
+	constexpr uint32_t c_journalVersion  = 1;
+
+	enum class JournalRecord : uint8_t { Begin = 1, Complete, Remove };
+
+	// BinaryStream only asserts on reading past the end, a manifest can be damaged or truncated on
+	// disk, so check before every read.
+	template<std::semiregular T>
+	bool ReadChecked(cecore::BinaryReader& a_stream, T& a_out) {
+		const uint32_t remaining = a_stream.Size - a_stream.Offset;
+		if constexpr(std::is_trivially_copyable_v<T>) {
+			if(remaining < sizeof(T)) { return false; }
+		} else {
+			uint32_t count{};
+			if(remaining < sizeof(count)) { return false; }
+			std::memcpy(&count, a_stream.Data + a_stream.Offset, sizeof(count));
+			if((remaining - sizeof(count)) / sizeof(typename T::value_type) < count) { return false; }
+		}
+		return cecore::Read(a_stream, a_out);
+	}
+
+	bool ReadChecked(cecore::BinaryReader& a_stream, fs::path& a_out) {
+		std::u8string path;
+		if(!ReadChecked(a_stream, path)) { return false; }
+		a_out = path;
+		return true;
+	}
+
+	bool ReadEntry(cecore::BinaryReader& a_stream, fs::path& a_key, cea::ManifestEntry& a_entry) {
+		return ReadChecked(a_stream, a_key) && ReadChecked(a_stream, a_entry.IsDirectory) &&
+		       ReadChecked(a_stream, a_entry.Size) && ReadChecked(a_stream, a_entry.LastWriteTime) &&
+		       ReadChecked(a_stream, a_entry.ContentId) && ReadChecked(a_stream, a_entry.Output) &&
+		       ReadChecked(a_stream, a_entry.Profile);
+	}
+
+	void WriteEntry(std::vector<std::byte>& a_stream, const fs::path& a_key,
+	                const cea::ManifestEntry& a_entry) {
+		cecore::Write(a_stream, a_key.generic_u8string());
+		cecore::Write(a_stream, a_entry.IsDirectory);
+		cecore::Write(a_stream, a_entry.Size);
+		cecore::Write(a_stream, a_entry.LastWriteTime);
+		cecore::Write(a_stream, a_entry.ContentId);
+		cecore::Write(a_stream, a_entry.Output.generic_u8string());
+		cecore::Write(a_stream, a_entry.Profile);
+	}
+
+	// Empty if a_path can't be mapped, or is too big for BinaryReader. All of it is read straight
+	// away, so it is read in up front.
+	std::optional<cep::MemoryMappedFile> MapFile(const fs::path& a_path) {
+		std::optional<cep::MemoryMappedFile> file(std::in_place, a_path, true);
+		if(!file->isValid() || file->size() > std::numeric_limits<uint32_t>::max()) {
+			return std::nullopt;
+		}
+		return file;
+	}
+}    // namespace
+
+std::optional<cea::SyncManifest> cea::LoadManifest(const fs::path& a_path) {
+	std::optional<cep::MemoryMappedFile> file = MapFile(a_path);
+	if(!file) { return std::nullopt; }
+	cecore::BinaryReader stream;
+	stream.Data = file->data();
+	stream.Size = (uint32_t)file->size();
+
+	uint64_t magic{};
+	uint32_t version{};
+	if(!ReadChecked(stream, magic) || magic != c_manifestMagic) { return std::nullopt; }
+	if(!ReadChecked(stream, version) || version != c_manifestVersion) { return std::nullopt; }
+
+	SyncManifest manifest;
+	uint32_t numEntries{};
+	if(!ReadChecked(stream, manifest.SourceRoot) || !ReadChecked(stream, manifest.DestRoot) ||
+	   !ReadChecked(stream, numEntries)) {
+		return std::nullopt;
+	}
+	manifest.Entries.reserve(numEntries);
+	for(uint32_t i = 0; i < numEntries; ++i) {
+		fs::path key;
+		ManifestEntry entry;
+		if(!ReadEntry(stream, key, entry)) { return std::nullopt; }
+		manifest.Entries.emplace(std::move(key), std::move(entry));
+	}
+	if(stream.Offset != stream.Size) { return std::nullopt; }
+	return manifest;
+}
+
+bool cea::SaveManifest(const fs::path& a_path, const SyncManifest& a_manifest) {
+	std::vector<std::byte> stream;
+	// paths are usually most of it.
+	stream.reserve(a_manifest.Entries.size() * 256);
+
+	cecore::Write(stream, c_manifestMagic);
+	cecore::Write(stream, c_manifestVersion);
+	cecore::Write(stream, a_manifest.SourceRoot.generic_u8string());
+	cecore::Write(stream, a_manifest.DestRoot.generic_u8string());
+	cecore::Write(stream, (uint32_t)a_manifest.Entries.size());
+	for(const auto& [key, entry] : a_manifest.Entries) { WriteEntry(stream, key, entry); }
+	if(stream.size() > std::numeric_limits<uint32_t>::max()) { return false; }
+
+	fs::path tempPath = a_path;
+	tempPath += ".partial";
+	bool written = false;
+	{
+		cecore::FileHandle file(tempPath, true);
+		if(file.asFile() == nullptr) { return false; }
+		written = std::fwrite(stream.data(), 1, stream.size(), file.asFile()) == stream.size() &&
+		          std::fflush(file.asFile()) == 0;
+	}
+	std::error_code ec;
+	if(written) { fs::rename(tempPath, a_path, ec); }
+	if(!written || ec) {
+		fs::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+cea::SyncJournal::SyncJournal(const fs::path& a_path, const fs::path& a_sourceRoot,
+                              const fs::path& a_destRoot) : m_file(a_path, true) {
+	std::vector<std::byte> header;
+	cecore::Write(header, c_journalMagic);
+	cecore::Write(header, c_journalVersion);
+	cecore::Write(header, a_sourceRoot.generic_u8string());
+	cecore::Write(header, a_destRoot.generic_u8string());
+	Append(header);
+}
+
+void cea::SyncJournal::Begin(const fs::path& a_key, const fs::path& a_output, bool a_inPlace) {
+	std::vector<std::byte> record;
+	cecore::Write(record, JournalRecord::Begin);
+	cecore::Write(record, a_key.generic_u8string());
+	cecore::Write(record, a_output.generic_u8string());
+	cecore::Write(record, a_inPlace);
+	Append(record);
+}
+
+void cea::SyncJournal::Complete(const fs::path& a_key, const ManifestEntry& a_entry) {
+	std::vector<std::byte> record;
+	cecore::Write(record, JournalRecord::Complete);
+	WriteEntry(record, a_key, a_entry);
+	Append(record);
+}
+
+void cea::SyncJournal::Remove(const fs::path& a_key) {
+	std::vector<std::byte> record;
+	cecore::Write(record, JournalRecord::Remove);
+	cecore::Write(record, a_key.generic_u8string());
+	Append(record);
+}
+
+void cea::SyncJournal::Append(const std::vector<std::byte>& a_record) {
+	std::scoped_lock lock(m_mutex);
+	if(!isValid()) { return; }
+	// once a write fails stop, a gap in the middle would replay as something it wasn't.
+	m_failed = std::fwrite(a_record.data(), 1, a_record.size(), m_file.asFile()) != a_record.size() ||
+	           std::fflush(m_file.asFile()) != 0;
+}
+
+bool cea::ReplayJournal(const fs::path& a_path, SyncManifest& a_manifest,
+                        std::vector<UnfinishedOutput>& a_unfinished) {
+	std::optional<cep::MemoryMappedFile> file = MapFile(a_path);
+	if(!file) { return false; }
+	cecore::BinaryReader stream;
+	stream.Data = file->data();
+	stream.Size = (uint32_t)file->size();
+
+	uint64_t magic{};
+	uint32_t version{};
+	fs::path sourceRoot;
+	fs::path destRoot;
+	if(!ReadChecked(stream, magic) || magic != c_journalMagic || !ReadChecked(stream, version) ||
+	   version != c_journalVersion || !ReadChecked(stream, sourceRoot) ||
+	   !ReadChecked(stream, destRoot) || sourceRoot != a_manifest.SourceRoot ||
+	   destRoot != a_manifest.DestRoot) {
+		return false;
+	}
+
+	// by key, begun and not completed yet.
+	std::unordered_map<fs::path, UnfinishedOutput, PathHash> begun;
+	JournalRecord type{};
+	while(ReadChecked(stream, type)) {
+		fs::path key;
+		if(type == JournalRecord::Begin) {
+			UnfinishedOutput output;
+			if(!ReadChecked(stream, key) || !ReadChecked(stream, output.Output) ||
+			   !ReadChecked(stream, output.InPlace)) {
+				break;
+			}
+			// a convert after a failed in place retag still leaves the output suspect if it stops.
+			UnfinishedOutput& unfinished = begun[key];
+			unfinished.Output            = std::move(output.Output);
+			unfinished.InPlace           = unfinished.InPlace || output.InPlace;
+		} else if(type == JournalRecord::Complete) {
+			ManifestEntry entry;
+			if(!ReadEntry(stream, key, entry)) { break; }
+			begun.erase(key);
+			a_manifest.Entries.insert_or_assign(std::move(key), std::move(entry));
+		} else if(type == JournalRecord::Remove) {
+			if(!ReadChecked(stream, key)) { break; }
+			a_manifest.Entries.erase(key);
+		} else {
+			break;
+		}
+	}
+
+	for(auto& [key, output] : begun) {
+		if(output.InPlace) { a_manifest.Entries.erase(key); }
+		a_unfinished.push_back(std::move(output));
+	}
+	return true;
+}
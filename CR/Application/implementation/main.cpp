@@ -21,14 +21,25 @@
 
 #include <opusenc.h>
 
+#include <speex/speex_resampler.h>
+
+#include <core/Log.hpp>
+
+#if defined(_WIN32)
 #include <CR/Engine/Platform/interface/platform/windows/CRWindows.h>
+#endif
 
 import CR.Engine;
+import CR.Application.DirectoryWalker;
+import CR.Application.Downmix;
+import CR.Application.OggOpus;
+import CR.Application.SyncManifest;
 
 import std;
 
 namespace cecore = CR::Engine::Core;
 namespace cep    = CR::Engine::Platform;
+namespace cea    = CR::Application;
 
 namespace fs = std::filesystem;
 
@@ -36,12 +47,52 @@ using namespace std::literals;
 
 enum class AppState { Idle, Converting, Cancelling };
 
+// Which resampler converts non 48k sources. Only one ever runs, libopusenc is always given 48k so
+// its own speex resampler stays off. Speex here is the same resampler from speexdsp, just run by us
+// so the quality can be picked.
+enum class ResamplerEngine { SincBest, SincMedium, SincFastest, Linear, Speex };
+constexpr std::array c_resamplerEngineNames{"sinc_best"sv, "sinc_medium"sv, "sinc_fastest"sv,
+                                            "linear"sv, "speex"sv};
+
+struct ResamplerConfig {
+	ResamplerEngine engine{ResamplerEngine::SincBest};
+	// 0-10, only used by the speex engine.
+	int32_t speexQuality{SPEEX_RESAMPLER_QUALITY_DESKTOP};
+};
+
+// Everything that trades encode time for quality. Profiles come from config.json and one is
+// picked in the ui before a conversion starts, every job in that conversion uses it.
+struct EncodeProfile {
+	std::string name;
+	int32_t complexity{10};
+	int32_t bitrate{256 * 1024};
+	ResamplerConfig resampler;
+};
+
 struct ConversionJob {
 	fs::path source;
 	fs::path dest;
+	std::shared_ptr<const EncodeProfile> profile;
+	// manifest key for the source, and what to record under it once the job succeeds.
+	fs::path relPath;
+	cea::ManifestEntry record;
+	// rough amount of work, channel samples to decode for a flac, bytes for a copy.
+	uint64_t cost{};
+};
+
+// An existing output that can be renamed to where a moved source now wants it, instead of encoding
+// the source again. convert is done instead if the rename fails. retag if its tags have to be
+// updated after the move as well.
+struct MoveJob {
+	fs::path from;
+	ConversionJob convert;
+	bool retag{};
 };
 
 const fs::path c_configPath{"config.json"};
+const fs::path c_manifestPath{"manifest.bin"};
+const fs::path c_dryRunPath{"dry_run.txt"};
+const fs::path c_journalPath{"sync_journal.bin"};
 
 AppState appState{AppState::Idle};
 
@@ -51,19 +102,102 @@ std::string sourcePathString;
 std::string destPathString;
 
 std::mutex dataMutex;
-int32_t numJobs{};
-int32_t completedJobs{};
-float convertProgress{};
+std::atomic_int32_t numJobs{};
+std::atomic_int32_t completedJobs{};
+std::atomic<float> convertProgress{};
 std::string Operation;
 std::mutex OperationMutex;
 std::mutex ErrorLogMutex;
 std::deque<std::string> ErrorLog;
 std::deque<std::move_only_function<void()>> workQueue;
+// number of workers currently running an item from workQueue, protected by dataMutex
+int32_t activeWorkers{};
 std::atomic_bool CancelWork;
 std::atomic_bool WorkCancelled;
 GLFWwindow* window{};
 
-std::jthread workerThread;
+// 0 means use one worker per hardware thread
+uint32_t workerThreadCount{};
+// How many conversions ahead of the ones running have their source read into the file cache, so
+// the next file is off the disk or network by the time a worker gets to it. 0 turns it off.
+uint32_t prefetchDepth{2};
+// Drop each source from the file cache once it has been converted or copied. A full sync reads
+// far more than fits in memory exactly once, which otherwise pushes everything else out of the
+// cache, including the destination folders the next sync plans from.
+bool evictSources{};
+
+std::vector<std::jthread> workerThreads;
+
+// What the destination will look like once the current run is done, saved when it ends, even if
+// cancelled. Workers record each output as it completes.
+std::mutex manifestMutex;
+cea::SyncManifest pendingManifest;
+bool manifestPending{};
+// Of the run in progress, only there while one is. Created before any work for the run is queued
+// and destroyed after it has all finished, so workers can use it without the lock.
+std::optional<cea::SyncJournal> journal;
+// Ignore the manifest and walk the destination too, for when it was changed by something else.
+bool fullRescan{};
+// Conversions normally go longest first, so no long track is left running on its own at the end
+// of a run. This does the most recently changed sources first instead, for when having the new
+// music synced soon matters more than finishing the whole run sooner.
+bool newestFirst{};
+
+// Measured speed of each kind of job, per worker per second, so a dry run can estimate how long a
+// sync will take. 0 until a run has measured it. Saved in config.json.
+struct Throughput {
+	// channel samples, by profile name since the profiles differ so much.
+	std::map<std::string, double> convert;
+	// bytes
+	double copy{};
+	// files
+	double retag{};
+	// deletes, folder adds and moves, which one worker does in a row before anything else.
+	double fileOps{};
+};
+Throughput throughput;
+
+// Used until there is a measurement. Conversion is about 30x realtime for 48KHz stereo.
+constexpr double c_defaultConvertThroughput = 30.0 * 48000 * 2;
+constexpr double c_defaultCopyThroughput    = 100.0 * 1024 * 1024;
+constexpr double c_defaultRetagThroughput   = 20.0;
+constexpr double c_defaultFileOpThroughput  = 500.0;
+
+// How much of each kind of job the current run has finished, and the worker time it took.
+struct JobTimes {
+	std::atomic_uint64_t units;
+	std::atomic_int64_t nanoseconds;
+};
+JobTimes convertTimes;
+JobTimes copyTimes;
+JobTimes retagTimes;
+JobTimes fileOpTimes;
+
+// Report from the last dry run, empty if there hasn't been one.
+std::string dryRunReport;
+
+// Sync whenever the source changes, once it has been quiet for c_watchSettleTime so copying in a
+// whole album is one sync instead of one per file. Only touched by the ui thread.
+constexpr auto c_watchSettleTime = 5s;
+bool watchSource{};
+std::optional<cep::DirectoryWatcher> sourceWatcher;
+std::unordered_set<fs::path, cea::PathHash> watchChanges;
+// the watcher missed events, need a normal sync to catch up.
+bool watchMissedEvents{};
+std::chrono::steady_clock::time_point lastWatchEvent;
+
+// Used when config.json doesn't have any. Only touched by the ui thread.
+std::vector<EncodeProfile> encodeProfiles{
+    {.name       = "archive",
+     .complexity = 10,
+     .bitrate    = 256 * 1024,
+     .resampler  = {.engine = ResamplerEngine::SincBest}},
+    {.name       = "initial-bulk",
+     .complexity = 3,
+     .bitrate    = 256 * 1024,
+     .resampler  = {.engine = ResamplerEngine::SincFastest}},
+};
+uint32_t selectedProfile{};
 
 template<typename... T>
 void AddError(fmt::format_string<T...> formatString, T&&... args) {
@@ -98,6 +232,23 @@ void ClearErrorLog() {
 	ErrorLog.clear();
 }
 
+void QueueWork(std::move_only_function<void()> a_workItem) {
+	std::scoped_lock loc(dataMutex);
+	workQueue.emplace_back(std::move(a_workItem));
+}
+
+// Call before starting to write the output of job. Once the job is recorded with RecordOutput,
+// the journal knows it finished.
+void JournalBegin(const ConversionJob& job, bool a_inPlace) {
+	if(journal) { journal->Begin(job.relPath, job.record.Output, a_inPlace); }
+}
+
+// Ahead of everything already queued, for work that something running is waiting on.
+void QueueWorkNext(std::move_only_function<void()> a_workItem) {
+	std::scoped_lock loc(dataMutex);
+	workQueue.emplace_front(std::move(a_workItem));
+}
+
 void LoadConfig() {
 	if(fs::exists(c_configPath)) {
 		simdjson::ondemand::parser parser;
@@ -106,14 +257,89 @@ void LoadConfig() {
 		simdjson::ondemand::document doc = parser.iterate(json);
 		sourcePath                       = std::string_view(doc["source_path"]);
 		destPath                         = std::string_view(doc["dest_path"]);
+
+		// optional, older config files won't have it
+		uint64_t threadCount{};
+		if(doc["worker_threads"].get(threadCount) == simdjson::SUCCESS) {
+			workerThreadCount = (uint32_t)threadCount;
+		}
+		uint64_t depth{};
+		if(doc["prefetch_depth"].get(depth) == simdjson::SUCCESS) { prefetchDepth = (uint32_t)depth; }
+		bool evict{};
+		if(doc["evict_sources"].get(evict) == simdjson::SUCCESS) { evictSources = evict; }
+
+		// profiles are optional too, any setting a profile leaves out gets the archive default.
+		simdjson::ondemand::array profiles;
+		if(doc["encode_profiles"].get(profiles) == simdjson::SUCCESS) {
+			std::vector<EncodeProfile> loadedProfiles;
+			for(auto profileValue : profiles) {
+				simdjson::ondemand::object profileObject;
+				if(profileValue.get(profileObject) != simdjson::SUCCESS) { continue; }
+				EncodeProfile profile;
+				std::string_view name;
+				if(profileObject["name"].get(name) != simdjson::SUCCESS) { continue; }
+				profile.name = name;
+				int64_t value{};
+				if(profileObject["complexity"].get(value) == simdjson::SUCCESS) {
+					profile.complexity = (int32_t)std::clamp<int64_t>(value, 0, 10);
+				}
+				if(profileObject["bitrate"].get(value) == simdjson::SUCCESS) {
+					profile.bitrate = (int32_t)std::clamp<int64_t>(value, 6000, 510000);
+				}
+				std::string_view resampler;
+				if(profileObject["resampler"].get(resampler) == simdjson::SUCCESS) {
+					auto engine = std::ranges::find(c_resamplerEngineNames, resampler);
+					if(engine != c_resamplerEngineNames.end()) {
+						profile.resampler.engine =
+						    (ResamplerEngine)(engine - c_resamplerEngineNames.begin());
+					}
+				}
+				if(profileObject["speex_quality"].get(value) == simdjson::SUCCESS) {
+					profile.resampler.speexQuality = (int32_t)std::clamp<int64_t>(
+					    value, SPEEX_RESAMPLER_QUALITY_MIN, SPEEX_RESAMPLER_QUALITY_MAX);
+				}
+				loadedProfiles.push_back(std::move(profile));
+			}
+			if(!loadedProfiles.empty()) { encodeProfiles = std::move(loadedProfiles); }
+		}
+		bool watch{};
+		if(doc["watch_source"].get(watch) == simdjson::SUCCESS) { watchSource = watch; }
+		bool newest{};
+		if(doc["newest_first"].get(newest) == simdjson::SUCCESS) { newestFirst = newest; }
+		simdjson::ondemand::object measured;
+		if(doc["throughput"].get(measured) == simdjson::SUCCESS) {
+			double value{};
+			if(measured["copy"].get(value) == simdjson::SUCCESS) { throughput.copy = value; }
+			if(measured["retag"].get(value) == simdjson::SUCCESS) { throughput.retag = value; }
+			if(measured["file_ops"].get(value) == simdjson::SUCCESS) { throughput.fileOps = value; }
+			simdjson::ondemand::object convert;
+			if(measured["convert"].get(convert) == simdjson::SUCCESS) {
+				for(auto field : convert) {
+					std::string_view profileName;
+					if(field.unescaped_key().get(profileName) == simdjson::SUCCESS &&
+					   field.value().get(value) == simdjson::SUCCESS) {
+						throughput.convert[std::string(profileName)] = value;
+					}
+				}
+			}
+		}
+		std::string_view profileName;
+		if(doc["encode_profile"].get(profileName) == simdjson::SUCCESS) {
+			auto profile = std::ranges::find(encodeProfiles, profileName, &EncodeProfile::name);
+			if(profile != encodeProfiles.end()) {
+				selectedProfile = (uint32_t)(profile - encodeProfiles.begin());
+			}
+		}
 	}
 }
 
-std::string EscapePathForJson(const fs::path& path) {
+std::string EscapeForJson(std::string_view text) {
 	std::string result;
-	for(const auto achar : path.string()) {
+	for(const auto achar : text) {
 		if(achar == '\\') {
 			result += "\\\\";
+		} else if(achar == '"') {
+			result += "\\\"";
 		} else {
 			result += achar;
 		}
@@ -121,312 +347,1037 @@ std::string EscapePathForJson(const fs::path& path) {
 	return result;
 }
 
+std::string EscapePathForJson(const fs::path& path) {
+	return EscapeForJson(path.string());
+}
+
 void SaveConfig() {
-	constexpr auto c_outputFormat = R"({{"source_path":"{}", "dest_path":"{}"}})";
+	constexpr auto c_outputFormat =
+	    R"({{"source_path":"{}", "dest_path":"{}", "worker_threads":{}, "watch_source":{}, )"
+	    R"("newest_first":{}, "prefetch_depth":{}, "evict_sources":{}, )"
+	    R"("encode_profile":"{}", "encode_profiles":[{}], "throughput":{}}})";
+	constexpr auto c_profileFormat =
+	    R"({}{{"name":"{}", "complexity":{}, "bitrate":{}, "resampler":"{}", "speex_quality":{}}})";
+	constexpr auto c_throughputFormat =
+	    R"({{"copy":{}, "retag":{}, "file_ops":{}, "convert":{{{}}}}})";
+
+	std::string profiles;
+	for(const auto& profile : encodeProfiles) {
+		profiles += fmt::format(fmt::runtime(c_profileFormat), profiles.empty() ? "" : ", ",
+		                        EscapeForJson(profile.name), profile.complexity, profile.bitrate,
+		                        c_resamplerEngineNames[(size_t)profile.resampler.engine],
+		                        profile.resampler.speexQuality);
+	}
+	std::string convertThroughput;
+	for(const auto& [profileName, value] : throughput.convert) {
+		convertThroughput += fmt::format(R"({}"{}":{})", convertThroughput.empty() ? "" : ", ",
+		                                 EscapeForJson(profileName), value);
+	}
+	auto throughputString =
+	    fmt::format(fmt::runtime(c_throughputFormat), throughput.copy, throughput.retag,
+	                throughput.fileOps, convertThroughput);
 
-	auto outputString = fmt::format(fmt::runtime(c_outputFormat), EscapePathForJson(sourcePath),
-	                                EscapePathForJson(destPath));
+	auto outputString = fmt::format(
+	    fmt::runtime(c_outputFormat), EscapePathForJson(sourcePath), EscapePathForJson(destPath),
+	    workerThreadCount, watchSource, newestFirst, prefetchDepth, evictSources,
+	    EscapeForJson(encodeProfiles[selectedProfile].name), profiles, throughputString);
 
 	std::ofstream outputFile(c_configPath);
 	outputFile << outputString;
 }
 
+// Extension of the last path component, including the dot, same rules as fs::path::extension
+// but a view into a_path so classifying an entry doesn't allocate.
+auto ExtensionOf(const fs::path& a_path) {
+	using StringView = std::basic_string_view<fs::path::value_type>;
+	constexpr fs::path::value_type c_separators[]{'/', fs::path::preferred_separator, 0};
+
+	StringView name      = a_path.native();
+	const auto separator = name.find_last_of(c_separators);
+	if(separator != StringView::npos) { name.remove_prefix(separator + 1); }
+	// dot files and .. have no extension
+	const auto dot = name.rfind('.');
+	if(dot == StringView::npos || dot == 0 || (name.size() == 2 && name[0] == '.')) {
+		return StringView{};
+	}
+	return name.substr(dot);
+}
+
+// a_lowerExtension has to be lower case ascii.
+bool HasExtensionIgnoreCase(const fs::path& a_path, std::string_view a_lowerExtension) {
+	const auto extension = ExtensionOf(a_path);
+	return std::ranges::equal(extension, a_lowerExtension, [](auto a_left, char a_right) {
+		// path chars are signed char on linux, a negative one would pass the < 128 and be undefined
+		// for tolower.
+		const auto code = (std::make_unsigned_t<fs::path::value_type>)a_left;
+		return code < 128 && std::tolower((int)code) == a_right;
+	});
+}
+
+bool HasExtension(const fs::path& a_path, std::string_view a_extension) {
+	return std::ranges::equal(ExtensionOf(a_path), a_extension,
+	                          [](auto a_left, char a_right) { return a_left == a_right; });
+}
+
+// Only looks at the extension, caller has to know it is a regular file.
 bool isPathToCopy(const fs::path& path) {
-	std::error_code ec;
-	if(!fs::is_regular_file(path, ec)) { return false; }
-	auto extension = path.extension().string();
-	for(char& c : extension) { c = (char)std::tolower(c); }
+	return HasExtensionIgnoreCase(path, ".mp3") || HasExtensionIgnoreCase(path, ".ogg") ||
+	       HasExtensionIgnoreCase(path, ".jpg") || HasExtensionIgnoreCase(path, ".opus");
+}
+
+struct FlacInfo {
+	uint64_t numFrames{};
+	uint32_t sampleRate{};
+	uint32_t numChannels{};
+	uint32_t bitsPerSample{};
+	// of the decoded audio, all 0 if the encoder didn't fill it in.
+	cea::Md5Digest md5{};
+
+	std::vector<std::string> comments;
+};
+
+// A mapped flac file, read through callbacks instead of drflac_open_memory so the read position
+// is tracked here rather than read out of dr_flac's private memory stream. Has to outlive the
+// decoder opened from it.
+struct MappedFlacStream {
+	cep::MemoryMappedFile* file{};
+	// filled in from the metadata blocks when opening, if set.
+	FlacInfo* info{};
+	// how far into file dr_flac has read, a little ahead of the frame being decoded.
+	std::size_t readPos{};
+};
+
+std::size_t OnFlacRead(void* pUserData, void* pBufferOut, std::size_t bytesToRead) {
+	auto* stream           = (MappedFlacStream*)pUserData;
+	const std::size_t size = std::min(bytesToRead, stream->file->size() - stream->readPos);
+	std::memcpy(pBufferOut, stream->file->data() + stream->readPos, size);
+	stream->readPos += size;
+	return size;
+}
+
+drflac_bool32 OnFlacSeek(void* pUserData, int offset, drflac_seek_origin origin) {
+	auto* stream = (MappedFlacStream*)pUserData;
+	int64_t base{};
+#if DRFLAC_VERSION_MINOR >= 13
+	if(origin == DRFLAC_SEEK_CUR) { base = (int64_t)stream->readPos; }
+	if(origin == DRFLAC_SEEK_END) { base = (int64_t)stream->file->size(); }
+#else
+	if(origin == drflac_seek_origin_current) { base = (int64_t)stream->readPos; }
+#endif
+	const int64_t readPos = base + offset;
+	if(readPos < 0 || readPos > (int64_t)stream->file->size()) { return DRFLAC_FALSE; }
+	stream->readPos = (std::size_t)readPos;
+	return DRFLAC_TRUE;
+}
+
+#if DRFLAC_VERSION_MINOR >= 13
+drflac_bool32 OnFlacTell(void* pUserData, drflac_int64* pCursor) {
+	*pCursor = (drflac_int64)((MappedFlacStream*)pUserData)->readPos;
+	return DRFLAC_TRUE;
+}
+#endif
+
+// dr_flac calls it for each metadata block, pUserData is a MappedFlacStream with info set.
+void FlacMetadataCallback(void* pUserData, drflac_metadata* pMetadata) {
+	FlacInfo* info = ((MappedFlacStream*)pUserData)->info;
+	if(pMetadata->type == DRFLAC_METADATA_BLOCK_TYPE_STREAMINFO) {
+		info->numFrames     = pMetadata->data.streaminfo.totalPCMFrameCount;
+		info->sampleRate    = pMetadata->data.streaminfo.sampleRate;
+		info->numChannels   = pMetadata->data.streaminfo.channels;
+		info->bitsPerSample = pMetadata->data.streaminfo.bitsPerSample;
+		std::memcpy(info->md5.data(), pMetadata->data.streaminfo.md5, info->md5.size());
+	}
+	if(pMetadata->type == DRFLAC_METADATA_BLOCK_TYPE_VORBIS_COMMENT) {
+		drflac_vorbis_comment_iterator commentIterator;
+		drflac_init_vorbis_comment_iterator(&commentIterator,
+		                                    pMetadata->data.vorbis_comment.commentCount,
+		                                    pMetadata->data.vorbis_comment.pComments);
+		uint32_t commentCount = pMetadata->data.vorbis_comment.commentCount;
+		info->comments.reserve(commentCount);
+		uint32_t commentLength{};
+		const char* comment = drflac_next_vorbis_comment(&commentIterator, &commentLength);
+		while(comment != nullptr) {
+			info->comments.emplace_back(comment, commentLength);
+			comment = drflac_next_vorbis_comment(&commentIterator, &commentLength);
+		}
+	}
+}
 
-	if((extension == ".mp3") || (extension == ".ogg") || (extension == ".jpg") ||
-	   (extension == ".opus")) {
-		return true;
+// Null if a_stream isn't a flac file. 0.13 added a tell callback.
+drflac* OpenFlac(MappedFlacStream& a_stream) {
+#if DRFLAC_VERSION_MINOR >= 13
+	if(a_stream.info != nullptr) {
+		return drflac_open_with_metadata(OnFlacRead, OnFlacSeek, OnFlacTell, FlacMetadataCallback,
+		                                 &a_stream, nullptr);
+	}
+	return drflac_open(OnFlacRead, OnFlacSeek, OnFlacTell, &a_stream, nullptr);
+#else
+	if(a_stream.info != nullptr) {
+		return drflac_open_with_metadata(OnFlacRead, OnFlacSeek, FlacMetadataCallback, &a_stream,
+		                                 nullptr);
 	}
-	return false;
+	return drflac_open(OnFlacRead, OnFlacSeek, &a_stream, nullptr);
+#endif
 }
 
-void ConvertFile(const ConversionJob& job) {
-	if(CancelWork.load()) { return; }
+// Track is streamed through decode, downmix, resample and encode one block at a time, so memory
+// use is fixed no matter how long the track is. Small enough that an 8 channel block and its
+// stereo downmix stay in L2.
+constexpr uint32_t c_blockFrames       = 4096;
+constexpr uint32_t c_numOutputChannels = 2;
+constexpr uint32_t c_targetSampleRate  = 48000;
+
+// Same goes for the source file. The whole file is mapped, but as the decoder moves through it the
+// pages it is done with are released, between one and two of these behind where it is reading. So
+// a multi GB image of a whole album takes no more memory than a single track would.
+constexpr uint64_t c_sourceWindowSize = 8 * 1024 * 1024;
+
+// Long tracks are split into segments that are encoded in parallel by separate opus encoders, then
+// stitched back together into a single ogg stream. Segment boundaries are on whole seconds, so they
+// land on both a 20ms opus frame and an exact source frame for any sample rate. Each encoder starts
+// a second early, and the packets from that pre-roll are thrown away. The pre-roll only lets the
+// resampler and encoder state settle so the seam isn't audible.
+constexpr uint32_t c_opusFrameSize           = 960;
+constexpr uint64_t c_parallelEncodeMinFrames = 20 * 60 * c_targetSampleRate;
+constexpr uint64_t c_minSegmentFrames        = 2 * 60 * c_targetSampleRate;
+constexpr uint64_t c_segmentPrerollFrames    = c_targetSampleRate;
+constexpr int32_t c_maxOpusPacketSize        = 1277 * 6 + 2;
+
+class PcmStream;
+
+// Setting up a resampler costs a lot more than a short track takes to resample, speex builds its
+// whole filter table in init. So finished resamplers are reset and kept, keyed by what they were
+// built for, and the next stream that needs the same thing takes one instead. There are never more
+// of each kind than there have been streams running at once.
+struct ResamplerKey {
+	// 0 for libsamplerate, its ratio is picked per call so a state works for any rate.
+	uint32_t sampleRate{};
+	ResamplerEngine engine{};
+	int32_t speexQuality{};
+
+	auto operator<=>(const ResamplerKey&) const = default;
+};
 
-	if(!fs::exists(job.source)) {
-		AddError("{} doesn't exist, logic error in app", job.source.string());
-		return;
+// libsamplerate binds the callback data when the state is created, so the callback gets this and
+// finds the stream currently using the state through it.
+struct SrcResampler {
+	~SrcResampler() {
+		if(state) { src_delete(state); }
 	}
+	SRC_STATE* state{};
+	PcmStream* stream{};
+};
 
-	if(fs::exists(job.dest)) { fs::remove(job.dest); }
+struct SpeexResampler {
+	~SpeexResampler() {
+		if(state) { speex_resampler_destroy(state); }
+	}
+	SpeexResamplerState* state{};
+};
 
-	cep::MemoryMappedFile sourceFile(job.source);
+template<typename ResamplerT>
+class ResamplerPool final {
+public:
+	// nullptr if there isn't an idle one for a_key.
+	[[nodiscard]] std::unique_ptr<ResamplerT> Take(const ResamplerKey& a_key) {
+		std::scoped_lock lock(m_mutex);
+		auto idle = m_idle.find(a_key);
+		if(idle == m_idle.end() || idle->second.empty()) { return nullptr; }
+		auto resampler = std::move(idle->second.back());
+		idle->second.pop_back();
+		return resampler;
+	}
 
-	struct FlacInfo {
-		uint32_t numFrames{};
-		uint32_t sampleRate{};
-		uint32_t numChannels{};
+	// a_resampler must already be reset.
+	void Return(const ResamplerKey& a_key, std::unique_ptr<ResamplerT> a_resampler) {
+		std::scoped_lock lock(m_mutex);
+		m_idle[a_key].push_back(std::move(a_resampler));
+	}
 
-		std::vector<std::string> comments;
-	};
-	FlacInfo flacInfo{};
+private:
+	std::mutex m_mutex;
+	std::map<ResamplerKey, std::vector<std::unique_ptr<ResamplerT>>> m_idle;
+};
+
+ResamplerPool<SrcResampler> srcResamplers;
+ResamplerPool<SpeexResampler> speexResamplers;
+
+// Fused decode, downmix and resample stage. The consumer pulls 48k stereo frames, and the stage
+// decodes a block at a time only as needed. Multichannel blocks are downmixed straight into the
+// buffer libsamplerate reads from, and libsamplerate writes straight into the consumer's buffer.
+// When no resample is needed the downmix, or for stereo the decoder itself, writes directly into
+// the consumer's buffer. Nothing larger than one decoded block is ever held.
+//
+// Resampling is done by either libsamplerate or the speex resampler, see ResamplerEngine. The
+// resampler comes from, and goes back to, one of the resampler pools.
+//
+// 16 bit sources that don't need a resample can also be pulled as int16_t, that skips the float
+// conversion in the decoder, downmixes in fixed point, and the encoder takes the int16_t as is.
+class PcmStream final {
+public:
+	// a_numFrames limits how many source frames are decoded from the current position of a_flac.
+	PcmStream(drflac* a_flac, const FlacInfo& a_info, uint64_t a_numFrames,
+	          const ResamplerConfig& a_resampler);
+	~PcmStream();
+	PcmStream(const PcmStream&)            = delete;
+	PcmStream& operator=(const PcmStream&) = delete;
+
+	// Fills a_dest with up to a_numFrames 48k stereo frames, returns how many were written. Only
+	// returns less than a_numFrames at the end of the stream, if cancelled, or on error.
+	[[nodiscard]] uint32_t Read(float* a_dest, uint32_t a_numFrames);
+	// Same as above, only valid if SupportsInteger. Don't mix with the float Read.
+	[[nodiscard]] uint32_t Read(int16_t* a_dest, uint32_t a_numFrames);
+
+	[[nodiscard]] bool SupportsInteger() const { return m_supportsInteger; }
+	[[nodiscard]] bool Failed() const { return m_failed; }
+	[[nodiscard]] uint64_t FramesDecoded() const { return m_framesDecoded; }
+
+	// a_source is what a_flac was opened from. Pages of it the decoder has moved past get released
+	// as it goes, see c_sourceWindowSize.
+	void ReleaseConsumed(MappedFlacStream& a_source);
+
+private:
+	// decodes and downmixes up to a_numFrames source frames into a_dest as stereo.
+	template<typename SampleT>
+	uint32_t DecodeStereo(SampleT* a_dest, uint32_t a_numFrames);
+	// no resample, decodes straight into a_dest until it is full.
+	template<typename SampleT>
+	uint32_t ReadDirect(SampleT* a_dest, uint32_t a_numFrames);
+	static long ResamplerInput(void* a_userData, float** a_data);
+	uint32_t ReadSpeex(float* a_dest, uint32_t a_numFrames);
+	void ReleaseSource();
+
+	drflac* m_flac{};
+	MappedFlacStream* m_source{};
+	// everything before this has been released, always a multiple of c_sourceWindowSize.
+	uint64_t m_sourceReleased{};
+	const cea::DownmixMatrix* m_downmixMatrix{};
+	uint32_t m_numChannels{};
+	uint64_t m_numFrames{};
+	uint64_t m_framesDecoded{};
+	uint32_t m_sampleRate{};
+	double m_resampleRatio{1.0};
+	ResamplerKey m_resamplerKey;
+	std::unique_ptr<SrcResampler> m_resampler;
+
+	std::unique_ptr<SpeexResampler> m_speex;
+	// frames of m_resamplerInput speex hasn't consumed yet
+	uint32_t m_speexInputOffset{};
+	uint32_t m_speexInputFrames{};
+	// silence still to feed speex after the end of input, flushes out its filter delay.
+	uint32_t m_speexFlushFrames{};
+	uint64_t m_speexFramesOut{};
+	bool m_supportsInteger{};
+	bool m_failed{};
+
+	// only the one matching the sample type being read is ever prepared.
+	cecore::StorageBuffer<float> m_decodeBuffer;
+	cecore::StorageBuffer<int16_t> m_decodeBufferS16;
+	cecore::StorageBuffer<float> m_resamplerInput;
+};
 
-	auto metaData = [](void* pUserData, drflac_metadata* pMetadata) {
-		FlacInfo* info = (FlacInfo*)pUserData;
-		if(pMetadata->type == DRFLAC_METADATA_BLOCK_TYPE_STREAMINFO) {
-			info->numFrames   = (uint32_t)pMetadata->data.streaminfo.totalPCMFrameCount;
-			info->sampleRate  = pMetadata->data.streaminfo.sampleRate;
-			info->numChannels = pMetadata->data.streaminfo.channels;
-		}
-		if(pMetadata->type == DRFLAC_METADATA_BLOCK_TYPE_VORBIS_COMMENT) {
-			drflac_vorbis_comment_iterator commentIterator;
-			drflac_init_vorbis_comment_iterator(&commentIterator,
-			                                    pMetadata->data.vorbis_comment.commentCount,
-			                                    pMetadata->data.vorbis_comment.pComments);
-			uint32_t commentCount = pMetadata->data.vorbis_comment.commentCount;
-			info->comments.reserve(commentCount);
-			uint32_t commentLength{};
-			const char* comment = drflac_next_vorbis_comment(&commentIterator, &commentLength);
-			while(comment != nullptr) {
-				info->comments.emplace_back(comment, commentLength);
-				comment = drflac_next_vorbis_comment(&commentIterator, &commentLength);
+PcmStream::PcmStream(drflac* a_flac, const FlacInfo& a_info, uint64_t a_numFrames,
+                     const ResamplerConfig& a_resampler) :
+    m_flac(a_flac), m_numChannels(a_info.numChannels), m_numFrames(a_numFrames),
+    m_sampleRate(a_info.sampleRate) {
+	// stereo sources don't need a downmix, they are fed to the next stage as is.
+	if(m_numChannels != c_numOutputChannels) {
+		m_downmixMatrix = cea::GetDownmixMatrix(m_numChannels);
+	}
+	// resampler only works in float, so anything that needs one stays float end to end.
+	m_supportsInteger = a_info.bitsPerSample <= 16 && a_info.sampleRate == c_targetSampleRate;
+
+	if(a_info.sampleRate == c_targetSampleRate) { return; }
+
+	m_resamplerInput.prepare(c_blockFrames * c_numOutputChannels);
+	m_resampleRatio = static_cast<double>(c_targetSampleRate) / a_info.sampleRate;
+	m_resamplerKey.engine = a_resampler.engine;
+	if(a_resampler.engine == ResamplerEngine::Speex) {
+		m_resamplerKey.sampleRate   = a_info.sampleRate;
+		m_resamplerKey.speexQuality = a_resampler.speexQuality;
+		m_speex                     = speexResamplers.Take(m_resamplerKey);
+		if(!m_speex) {
+			int error{};
+			m_speex        = std::make_unique<SpeexResampler>();
+			m_speex->state = speex_resampler_init(c_numOutputChannels, a_info.sampleRate,
+			                                      c_targetSampleRate, a_resampler.speexQuality, &error);
+			if(m_speex->state == nullptr) {
+				AddError("error converted sample rate {}", speex_resampler_strerror(error));
+				m_speex.reset();
+				m_failed = true;
+				return;
 			}
 		}
-	};
-	auto drFlac = drflac_open_memory_with_metadata(sourceFile.data(), sourceFile.size(), metaData,
-	                                               &flacInfo, nullptr);
-	if(flacInfo.numFrames == 0) {
-		AddError("{} could not read flac uncompressed size", job.source.string());
+		// lines the output up with the input, and the flush at the end gets the tail back.
+		speex_resampler_skip_zeros(m_speex->state);
+		m_speexFlushFrames = (uint32_t)speex_resampler_get_input_latency(m_speex->state);
 		return;
 	}
 
-	cecore::StorageBuffer<float> pcmData[2];
-	uint32_t currentBufferIndex = 0;
-	uint32_t workingBufferIndex = 1;
-	auto nextBuffer             = [&] { std::swap(currentBufferIndex, workingBufferIndex); };
-
-	auto currentBuffer = [&]() -> auto& { return pcmData[currentBufferIndex]; };
-	auto workingBuffer = [&]() -> auto& { return pcmData[workingBufferIndex]; };
-
-	currentBuffer().prepare(flacInfo.numFrames * flacInfo.numChannels);
-
-	auto framesRead = drflac_read_pcm_frames_f32(drFlac, flacInfo.numFrames, currentBuffer().data());
-	if(framesRead != flacInfo.numFrames) {
-		AddError("{} was shorter than expected, corrupted data?", job.source.string());
+	m_resampler = srcResamplers.Take(m_resamplerKey);
+	if(m_resampler) {
+		m_resampler->stream = this;
+		return;
 	}
-	flacInfo.numFrames = (uint32_t)framesRead;
-	drflac_close(drFlac);
 
-	currentBuffer().commit(flacInfo.numFrames * flacInfo.numChannels);
-
-	if(CancelWork.load()) { return; }
-
-	// flac says by default channel layout is
-	// 1 channel - mono
-	// 2 channel - left, right
-	// 3 channel - left, right, center
-	// 4 channel - left, right, back left, back right
-	// 5 channel - left, right, center, back left, back right
-	// 6 channel - left, right, center, LFE, back left, back right
-	// 7 channel - left, right, center, LFE, back center, back left, back right
-	// 8 channel - left, right, center, LFE, back left, back right, side left, side right
-	// mostly just following suggestion in
-	// https://www.atsc.org/wp-content/uploads/2015/03/A52-201212-17.pdf to merge
-	// I don't have sdev and cdev, so just going to mix center at -3db and rears at -6db.
-
-	constexpr uint32_t numOutputChannels = 2;
-
-	// only going to output stereo, so need to merge/duplicate channels as appropriate.
-	switch(flacInfo.numChannels) {
-		case 1:
-			// mono, need to duplicate
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					destPtr[2 * frame + 0] = srcPtr[frame];
-					destPtr[2 * frame + 1] = srcPtr[frame];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
-			}
-			break;
-		case 2:
-			// already stereo, nothing to do
+	int filterQuality = SRC_SINC_BEST_QUALITY;
+	switch(a_resampler.engine) {
+		case ResamplerEngine::SincMedium:
+			filterQuality = SRC_SINC_MEDIUM_QUALITY;
 			break;
-		case 3:
-			// left, right, center
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					// mix center channel at -3db into left and right
-					constexpr float mainChannelMix   = 1.0f / 1.707f;
-					constexpr float centerChannelMix = 0.707f / 1.707f;
-					destPtr[2 * frame + 0] =
-					    mainChannelMix * srcPtr[3 * frame + 0] + centerChannelMix * srcPtr[3 * frame + 2];
-					destPtr[2 * frame + 1] =
-					    mainChannelMix * srcPtr[3 * frame + 1] + centerChannelMix * srcPtr[3 * frame + 2];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
-			}
+		case ResamplerEngine::SincFastest:
+			filterQuality = SRC_SINC_FASTEST;
 			break;
-		case 4:
-			// left, right, back left, back right
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					// mix rear channels at -6db
-					constexpr float mainChannelMix = 1.0f / 1.5f;
-					constexpr float rearChannelMix = 0.5f / 1.5f;
-					destPtr[2 * frame + 0] =
-					    mainChannelMix * srcPtr[4 * frame + 0] + rearChannelMix * srcPtr[4 * frame + 2];
-					destPtr[2 * frame + 1] =
-					    mainChannelMix * srcPtr[4 * frame + 1] + rearChannelMix * srcPtr[4 * frame + 3];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
-			}
+		case ResamplerEngine::Linear:
+			filterQuality = SRC_LINEAR;
 			break;
-		case 5:
-			// left, right, center, back left, back right
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					// mix center at -3db, rear channels at -6db
-					constexpr float channelMixTotal  = 1.0f + 0.707f + 0.5f;
-					constexpr float mainChannelMix   = 1.0f / channelMixTotal;
-					constexpr float centerChannelMix = 0.707f / channelMixTotal;
-					constexpr float rearChannelMix   = 0.5f / channelMixTotal;
-					destPtr[2 * frame + 0]           = mainChannelMix * srcPtr[5 * frame + 0] +
-					                         centerChannelMix * srcPtr[5 * frame + 2] +
-					                         rearChannelMix * srcPtr[5 * frame + 3];
-					destPtr[2 * frame + 1] = mainChannelMix * srcPtr[5 * frame + 1] +
-					                         centerChannelMix * srcPtr[5 * frame + 2] +
-					                         rearChannelMix * srcPtr[5 * frame + 4];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
-			}
+		default:
 			break;
-		case 6:
-			// left, right, center, LFE, back left, back right
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					// mix center at -3db, rear channels at -6db, LFE at identity
-					constexpr float channelMixTotal  = 1.0f + 0.707f + 0.5f + 1.0f;
-					constexpr float mainChannelMix   = 1.0f / channelMixTotal;
-					constexpr float centerChannelMix = 0.707f / channelMixTotal;
-					constexpr float lfeChannelMix    = 1.0f / channelMixTotal;
-					constexpr float rearChannelMix   = 0.5f / channelMixTotal;
-					destPtr[2 * frame + 0] =
-					    mainChannelMix * srcPtr[6 * frame + 0] + centerChannelMix * srcPtr[6 * frame + 2] +
-					    lfeChannelMix * srcPtr[6 * frame + 3] + rearChannelMix * srcPtr[6 * frame + 4];
-					destPtr[2 * frame + 1] =
-					    mainChannelMix * srcPtr[6 * frame + 1] + centerChannelMix * srcPtr[6 * frame + 2] +
-					    lfeChannelMix * srcPtr[6 * frame + 3] + rearChannelMix * srcPtr[6 * frame + 5];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
+	}
+	// libsamplerate keeps its filter history between calls, so block boundaries are seamless.
+	int error{};
+	m_resampler         = std::make_unique<SrcResampler>();
+	m_resampler->stream = this;
+	m_resampler->state  = src_callback_new(ResamplerInput, filterQuality, c_numOutputChannels,
+	                                       &error, m_resampler.get());
+	if(m_resampler->state == nullptr) {
+		AddError("error converted sample rate {}", src_strerror(error));
+		m_resampler.reset();
+		m_failed = true;
+	}
+}
+
+PcmStream::~PcmStream() {
+	// a resampler that hit an error might not be in a usable state, just let it go.
+	if(m_resampler && src_error(m_resampler->state) == 0) {
+		src_reset(m_resampler->state);
+		m_resampler->stream = nullptr;
+		srcResamplers.Return(m_resamplerKey, std::move(m_resampler));
+	}
+	if(m_speex) {
+		speex_resampler_reset_mem(m_speex->state);
+		speexResamplers.Return(m_resamplerKey, std::move(m_speex));
+	}
+}
+
+template<typename SampleT>
+uint32_t PcmStream::DecodeStereo(SampleT* a_dest, uint32_t a_numFrames) {
+	if(CancelWork.load()) {
+		m_failed = true;
+		return 0;
+	}
+	auto framesToRead = (uint32_t)std::min<uint64_t>(
+	    {c_blockFrames, a_numFrames, m_numFrames - m_framesDecoded});
+	if(framesToRead == 0) { return 0; }
+
+	auto readFrames = [&](SampleT* a_buffer) {
+		if constexpr(std::is_same_v<SampleT, int16_t>) {
+			return (uint32_t)drflac_read_pcm_frames_s16(m_flac, framesToRead, a_buffer);
+		} else {
+			return (uint32_t)drflac_read_pcm_frames_f32(m_flac, framesToRead, a_buffer);
+		}
+	};
+
+	uint32_t framesRead{};
+	if(m_downmixMatrix == nullptr) {
+		framesRead = readFrames(a_dest);
+	} else {
+		auto& decodeBuffer = [&]() -> auto& {
+			if constexpr(std::is_same_v<SampleT, int16_t>) {
+				return m_decodeBufferS16;
+			} else {
+				return m_decodeBuffer;
 			}
-			break;
-		case 7:
-			// left, right, center, LFE, back center, back left, back right
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					// mix center at -3db, rear channels at -6db, LFE at identity
-					constexpr float channelMixTotal  = 1.0f + 0.707f + 0.5f + 1.0f + 0.5f;
-					constexpr float mainChannelMix   = 1.0f / channelMixTotal;
-					constexpr float centerChannelMix = 0.707f / channelMixTotal;
-					constexpr float lfeChannelMix    = 1.0f / channelMixTotal;
-					constexpr float rearChannelMix   = 0.5f / channelMixTotal;
-					destPtr[2 * frame + 0] =
-					    mainChannelMix * srcPtr[7 * frame + 0] + centerChannelMix * srcPtr[7 * frame + 2] +
-					    lfeChannelMix * srcPtr[7 * frame + 3] + rearChannelMix * srcPtr[7 * frame + 4] +
-					    rearChannelMix * srcPtr[7 * frame + 5];
-					destPtr[2 * frame + 1] =
-					    mainChannelMix * srcPtr[7 * frame + 1] + centerChannelMix * srcPtr[7 * frame + 2] +
-					    lfeChannelMix * srcPtr[7 * frame + 3] + rearChannelMix * srcPtr[7 * frame + 4] +
-					    rearChannelMix * srcPtr[7 * frame + 6];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
+		}();
+		if(decodeBuffer.capacity() == 0) { decodeBuffer.prepare(c_blockFrames * m_numChannels); }
+		framesRead = readFrames(decodeBuffer.data());
+		cea::Downmix(*m_downmixMatrix, decodeBuffer.data(), a_dest, framesRead);
+	}
+	m_framesDecoded += framesRead;
+	// short read means the stream ended early, don't ask the decoder again.
+	if(framesRead < framesToRead) { m_numFrames = m_framesDecoded; }
+	if(m_source != nullptr) { ReleaseSource(); }
+	return framesRead;
+}
+
+void PcmStream::ReleaseConsumed(MappedFlacStream& a_source) {
+	m_source = &a_source;
+	// nothing before the current position is released, the segment before this one could still be
+	// reading it.
+	const uint64_t readPos = m_source->readPos;
+	m_sourceReleased = (readPos + c_sourceWindowSize - 1) / c_sourceWindowSize * c_sourceWindowSize;
+}
+
+void PcmStream::ReleaseSource() {
+	const uint64_t readPos = m_source->readPos;
+	if(readPos < m_sourceReleased + 2 * c_sourceWindowSize) { return; }
+	const uint64_t releaseTo = readPos - readPos % c_sourceWindowSize - c_sourceWindowSize;
+	m_source->file->Release(m_sourceReleased, releaseTo - m_sourceReleased);
+	m_sourceReleased = releaseTo;
+}
+
+template<typename SampleT>
+uint32_t PcmStream::ReadDirect(SampleT* a_dest, uint32_t a_numFrames) {
+	uint32_t framesWritten = 0;
+	while(framesWritten < a_numFrames) {
+		uint32_t frames = DecodeStereo(a_dest + framesWritten * c_numOutputChannels,
+		                               a_numFrames - framesWritten);
+		if(frames == 0) { break; }
+		framesWritten += frames;
+	}
+	return framesWritten;
+}
+
+long PcmStream::ResamplerInput(void* a_userData, float** a_data) {
+	auto* stream = ((SrcResampler*)a_userData)->stream;
+	*a_data      = stream->m_resamplerInput.data();
+	return stream->DecodeStereo(stream->m_resamplerInput.data(), c_blockFrames);
+}
+
+uint32_t PcmStream::Read(float* a_dest, uint32_t a_numFrames) {
+	if(m_failed) { return 0; }
+
+	if(m_speex) { return ReadSpeex(a_dest, a_numFrames); }
+	if(m_resampler == nullptr) { return ReadDirect(a_dest, a_numFrames); }
+
+	// libsamplerate pulls input through ResamplerInput until it has a_numFrames, or the input runs
+	// out and it has flushed everything it was holding.
+	auto framesWritten =
+	    (uint32_t)src_callback_read(m_resampler->state, m_resampleRatio, a_numFrames, a_dest);
+	if(int error = src_error(m_resampler->state); error != 0) {
+		AddError("error converted sample rate {}", src_strerror(error));
+		m_failed = true;
+	}
+	return framesWritten;
+}
+
+uint32_t PcmStream::ReadSpeex(float* a_dest, uint32_t a_numFrames) {
+	// speex has no end of input, so the flush would give a few frames past the real end. The
+	// source length can shrink if the decoder hits the end early, so check it every time around.
+	auto outputFrames = [&]() {
+		return (m_numFrames * c_targetSampleRate + m_sampleRate - 1) / m_sampleRate;
+	};
+
+	uint32_t framesWritten = 0;
+	while(framesWritten < a_numFrames && m_speexFramesOut < outputFrames()) {
+		if(m_speexInputOffset == m_speexInputFrames) {
+			m_speexInputOffset = 0;
+			m_speexInputFrames = DecodeStereo(m_resamplerInput.data(), c_blockFrames);
+			if(m_failed) { break; }
+			if(m_speexInputFrames == 0) {
+				if(m_speexFlushFrames == 0) { break; }
+				m_speexInputFrames = std::min(m_speexFlushFrames, c_blockFrames);
+				m_speexFlushFrames -= m_speexInputFrames;
+				std::fill_n(m_resamplerInput.data(), m_speexInputFrames * c_numOutputChannels, 0.0f);
 			}
+			if(m_speexFramesOut >= outputFrames()) { break; }
+		}
+
+		spx_uint32_t inputFrames = m_speexInputFrames - m_speexInputOffset;
+		spx_uint32_t outputSpace = (spx_uint32_t)std::min<uint64_t>(
+		    a_numFrames - framesWritten, outputFrames() - m_speexFramesOut);
+		int error = speex_resampler_process_interleaved_float(
+		    m_speex->state, m_resamplerInput.data() + m_speexInputOffset * c_numOutputChannels,
+		    &inputFrames, a_dest + framesWritten * c_numOutputChannels, &outputSpace);
+		if(error != RESAMPLER_ERR_SUCCESS) {
+			AddError("error converted sample rate {}", speex_resampler_strerror(error));
+			m_failed = true;
 			break;
-		case 8:
-			// left, right, center, LFE, back left, back right, side left, side right
-			{
-				nextBuffer();
-				currentBuffer().prepare(flacInfo.numFrames * numOutputChannels);
-				auto srcPtr  = workingBuffer().data();
-				auto destPtr = currentBuffer().data();
-				for(uint32_t frame = 0; frame < flacInfo.numFrames; ++frame) {
-					// mix center at -3db, rear channels at -6db, LFE at identity
-					constexpr float channelMixTotal  = 1.0f + 0.707f + 0.5f + 1.0f + 0.5f;
-					constexpr float mainChannelMix   = 1.0f / channelMixTotal;
-					constexpr float centerChannelMix = 0.707f / channelMixTotal;
-					constexpr float lfeChannelMix    = 1.0f / channelMixTotal;
-					constexpr float rearChannelMix   = 0.5f / channelMixTotal;
-					destPtr[2 * frame + 0] =
-					    mainChannelMix * srcPtr[8 * frame + 0] + centerChannelMix * srcPtr[8 * frame + 2] +
-					    lfeChannelMix * srcPtr[8 * frame + 3] + rearChannelMix * srcPtr[8 * frame + 4] +
-					    rearChannelMix * srcPtr[8 * frame + 6];
-					destPtr[2 * frame + 1] =
-					    mainChannelMix * srcPtr[8 * frame + 1] + centerChannelMix * srcPtr[8 * frame + 2] +
-					    lfeChannelMix * srcPtr[8 * frame + 3] + rearChannelMix * srcPtr[8 * frame + 5] +
-					    rearChannelMix * srcPtr[8 * frame + 7];
-				}
-				currentBuffer().commit(flacInfo.numFrames * numOutputChannels);
+		}
+		m_speexInputOffset += inputFrames;
+		m_speexFramesOut += outputSpace;
+		framesWritten += outputSpace;
+	}
+	return framesWritten;
+}
+
+uint32_t PcmStream::Read(int16_t* a_dest, uint32_t a_numFrames) {
+	CR_ASSERT(m_supportsInteger, "16 bit read from a stream that needs to be resampled");
+	if(m_failed) { return 0; }
+	return ReadDirect(a_dest, a_numFrames);
+}
+
+void ConfigureOpusEncoder(OpusEncoder* a_encoder, const EncodeProfile& a_profile) {
+	// same settings libopusenc uses, so segment packets match what ope_encoder_write_float makes.
+	opus_encoder_ctl(a_encoder, OPUS_SET_EXPERT_FRAME_DURATION(OPUS_FRAMESIZE_20_MS));
+	opus_encoder_ctl(a_encoder, OPUS_SET_COMPLEXITY(a_profile.complexity));
+	opus_encoder_ctl(a_encoder, OPUS_SET_BITRATE(a_profile.bitrate));
+}
+
+// Ogg pages are small, and each one written on its own is a separate network write on a NAS.
+// OutputFile collects them in memory and writes them out in big chunks, most tracks fit in one
+// chunk and go out in a single write. Everything goes to a temp file next to the destination that
+// Commit renames over it, so a failed or cancelled conversion leaves the old file, if any, alone
+// and never leaves a partial one under the real name.
+constexpr size_t c_outputChunkSize = 16 * 1024 * 1024;
+
+class OutputFile final {
+public:
+	// a_estimatedSize is only used to size the buffer.
+	OutputFile(const fs::path& a_dest, uint64_t a_estimatedSize);
+	~OutputFile();
+	OutputFile(const OutputFile&)            = delete;
+	OutputFile& operator=(const OutputFile&) = delete;
+
+	// false if the temp file couldn't be created, or a chunk failed to write.
+	[[nodiscard]] bool Write(const unsigned char* a_data, size_t a_size);
+	// Writes whatever is left and moves the file into place.
+	[[nodiscard]] bool Commit();
+
+	// for ope_encoder_create_callbacks
+	static int WriteCallback(void* a_userData, const unsigned char* a_data, opus_int32 a_size);
+	static int CloseCallback(void*) { return 0; }
+
+private:
+	bool Flush();
+
+	fs::path m_dest;
+	fs::path m_tempPath;
+	// reset to close it
+	std::optional<cecore::FileHandle> m_file;
+	std::vector<unsigned char> m_buffer;
+	bool m_failed{};
+	bool m_committed{};
+};
+
+OutputFile::OutputFile(const fs::path& a_dest, uint64_t a_estimatedSize) :
+    m_dest(a_dest), m_tempPath(fs::path(a_dest) += ".partial") {
+	m_file.emplace(m_tempPath, true);
+	if(m_file->asFile() == nullptr) {
+		m_failed = true;
+		return;
+	}
+	// everything is written in big chunks already, stdio buffering would just add a copy.
+	std::setvbuf(m_file->asFile(), nullptr, _IONBF, 0);
+	m_buffer.reserve((size_t)std::min<uint64_t>(a_estimatedSize, c_outputChunkSize));
+}
+
+OutputFile::~OutputFile() {
+	if(m_committed) { return; }
+	m_file.reset();
+	std::error_code ec;
+	fs::remove(m_tempPath, ec);
+}
+
+bool OutputFile::Write(const unsigned char* a_data, size_t a_size) {
+	if(m_failed) { return false; }
+	while(a_size > 0) {
+		size_t bytes = std::min(a_size, c_outputChunkSize - m_buffer.size());
+		m_buffer.insert(m_buffer.end(), a_data, a_data + bytes);
+		a_data += bytes;
+		a_size -= bytes;
+		if(m_buffer.size() == c_outputChunkSize && !Flush()) { return false; }
+	}
+	return true;
+}
+
+bool OutputFile::Flush() {
+	if(m_failed) { return false; }
+	if(std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file->asFile()) != m_buffer.size()) {
+		m_failed = true;
+		return false;
+	}
+	m_buffer.clear();
+	return true;
+}
+
+bool OutputFile::Commit() {
+	if(!Flush()) { return false; }
+	// close before the rename, windows won't move an open file.
+	m_file.reset();
+	std::error_code ec;
+	fs::rename(m_tempPath, m_dest, ec);
+	if(ec) {
+		m_failed = true;
+		return false;
+	}
+	m_committed = true;
+	return true;
+}
+
+int OutputFile::WriteCallback(void* a_userData, const unsigned char* a_data, opus_int32 a_size) {
+	return ((OutputFile*)a_userData)->Write(a_data, (size_t)a_size) ? 0 : 1;
+}
+
+struct EncodedSegment {
+	std::vector<unsigned char> packetData;
+	std::vector<uint32_t> packetSizes;
+};
+
+// Shared between ConvertFile and the helper work items. Helpers that get dequeued after every
+// segment has been claimed just return, they may run after ConvertFile is done with sourceFile and
+// flacInfo, so those are only touched after a successful claim.
+struct SegmentedEncode {
+	SegmentedEncode(uint32_t a_numSegments) :
+	    segments(a_numSegments), segmentsDone(a_numSegments) {}
+
+	cep::MemoryMappedFile* sourceFile{};
+	const FlacInfo* flacInfo{};
+	std::shared_ptr<const EncodeProfile> profile;
+	fs::path source;
+	uint64_t outputFrames{};
+	uint64_t segmentFrames{};
+	int32_t preskip{};
+
+	std::vector<EncodedSegment> segments;
+	std::atomic_uint32_t nextSegment{};
+	std::atomic_bool failed{};
+	std::latch segmentsDone;
+};
+
+// Encodes packets [a_firstPacket, a_endPacket) of a segment, keeping those from a_firstKeptPacket
+// on. Each 20ms frame is pulled straight into the buffer the encoder reads, the final frame and
+// the encoder lookahead are padded with silence. Anything decoded past the end of the segment is
+// just resampler filter tail and is never pulled.
+template<typename SampleT>
+bool EncodePackets(PcmStream& a_pcm, OpusEncoder* a_encoder, uint64_t a_firstPacket,
+                   uint64_t a_firstKeptPacket, uint64_t a_endPacket, EncodedSegment& a_result) {
+	std::array<SampleT, c_opusFrameSize * c_numOutputChannels> frame;
+	std::array<unsigned char, c_maxOpusPacketSize> packet;
+
+	for(uint64_t packetNumber = a_firstPacket; packetNumber < a_endPacket; ++packetNumber) {
+		uint32_t frameFill = a_pcm.Read(frame.data(), c_opusFrameSize);
+		if(a_pcm.Failed()) { return false; }
+		std::fill(frame.begin() + frameFill * c_numOutputChannels, frame.end(), SampleT{});
+
+		opus_int32 bytes{};
+		if constexpr(std::is_same_v<SampleT, int16_t>) {
+			bytes = opus_encode(a_encoder, frame.data(), c_opusFrameSize, packet.data(),
+			                    (opus_int32)packet.size());
+		} else {
+			bytes = opus_encode_float(a_encoder, frame.data(), c_opusFrameSize, packet.data(),
+			                          (opus_int32)packet.size());
+		}
+		if(bytes < 0) {
+			AddError("Failed to write data to opus encoder. {}", opus_strerror(bytes));
+			return false;
+		}
+		if(packetNumber >= a_firstKeptPacket) {
+			a_result.packetData.insert(a_result.packetData.end(), packet.data(),
+			                           packet.data() + bytes);
+			a_result.packetSizes.push_back((uint32_t)bytes);
+		}
+	}
+	return true;
+}
+
+void EncodeSegment(SegmentedEncode& a_state, uint32_t a_segment) {
+	const FlacInfo& flacInfo = *a_state.flacInfo;
+	EncodedSegment& result   = a_state.segments[a_segment];
+	const bool lastSegment   = a_segment + 1 == a_state.segments.size();
+
+	const uint64_t segmentStart = a_segment * a_state.segmentFrames;
+	const uint64_t segmentEnd = std::min(segmentStart + a_state.segmentFrames, a_state.outputFrames);
+	const uint64_t encodeStart = segmentStart - std::min(segmentStart, c_segmentPrerollFrames);
+	const uint64_t firstPacket = encodeStart / c_opusFrameSize;
+	const uint64_t firstKeptPacket = segmentStart / c_opusFrameSize;
+	// last segment keeps going until the encoder lookahead has been flushed out, same as
+	// ope_encoder_drain.
+	const uint64_t endPacket =
+	    lastSegment ? (a_state.outputFrames + a_state.preskip + c_opusFrameSize - 1) / c_opusFrameSize
+	                : segmentEnd / c_opusFrameSize;
+
+	MappedFlacStream flacStream{a_state.sourceFile};
+	drflac* drFlac = OpenFlac(flacStream);
+	if(drFlac == nullptr) {
+		AddError("{} could not be opened as a flac file", a_state.source.string());
+		a_state.failed.store(true);
+		return;
+	}
+	auto closeFlac = cecore::defer([&] { drflac_close(drFlac); });
+
+	const uint64_t sourceStart = encodeStart * flacInfo.sampleRate / c_targetSampleRate;
+	if(!drflac_seek_to_pcm_frame(drFlac, sourceStart)) {
+		AddError("{} could not seek to segment {}, corrupted data?", a_state.source.string(),
+		         a_segment);
+		a_state.failed.store(true);
+		return;
+	}
+	// run a block past the end of the segment, the resampler needs the filter tail for its last
+	// frames. Anything past segmentEnd is thrown away.
+	uint64_t sourceEnd = flacInfo.numFrames;
+	if(!lastSegment) {
+		sourceEnd = std::min(segmentEnd * flacInfo.sampleRate / c_targetSampleRate + c_blockFrames,
+		                     flacInfo.numFrames);
+	}
+
+	int error{};
+	OpusEncoder* encoder =
+	    opus_encoder_create(c_targetSampleRate, c_numOutputChannels, OPUS_APPLICATION_AUDIO, &error);
+	if(encoder == nullptr) {
+		AddError("Failed to created opus encoder. {}", opus_strerror(error));
+		a_state.failed.store(true);
+		return;
+	}
+	auto destroyEncoder = cecore::defer([&] { opus_encoder_destroy(encoder); });
+	ConfigureOpusEncoder(encoder, *a_state.profile);
+
+	const uint64_t bytesPerPacket = a_state.profile->bitrate / 8 / 50;
+	result.packetData.reserve((endPacket - firstKeptPacket) * bytesPerPacket);
+	result.packetSizes.reserve(endPacket - firstKeptPacket);
+
+	PcmStream pcm(drFlac, flacInfo, sourceEnd - sourceStart, a_state.profile->resampler);
+	pcm.ReleaseConsumed(flacStream);
+	bool encoded = pcm.SupportsInteger() ?
+	                   EncodePackets<int16_t>(pcm, encoder, firstPacket, firstKeptPacket, endPacket,
+	                                          result) :
+	                   EncodePackets<float>(pcm, encoder, firstPacket, firstKeptPacket, endPacket,
+	                                        result);
+	if(!encoded) { a_state.failed.store(true); }
+}
+
+// Claims and encodes segments until there are none left.
+void EncodeSegments(SegmentedEncode& a_state) {
+	uint32_t segment = a_state.nextSegment++;
+	while(segment < a_state.segments.size()) {
+		if(!a_state.failed.load()) { EncodeSegment(a_state, segment); }
+		a_state.segmentsDone.count_down();
+		segment = a_state.nextSegment++;
+	}
+}
+
+bool WriteSegmentedOpus(const fs::path& a_dest, const FlacInfo& a_flacInfo,
+                        const SegmentedEncode& a_state) {
+	// packets plus about 1% ogg overhead, and the headers.
+	uint64_t estimatedSize = 64 * 1024;
+	for(const auto& segment : a_state.segments) {
+		estimatedSize += segment.packetData.size() + segment.packetData.size() / 100;
+	}
+	OutputFile outputFile(a_dest, estimatedSize);
+
+	std::random_device randomDevice;
+	cea::OggPacker packer(randomDevice());
+	if(!packer.isValid()) {
+		AddError("Out of memory creating the ogg stream for {}", a_dest.string());
+		return false;
+	}
+	packer.SetMuxingDelay(c_targetSampleRate);
+
+	bool writeFailed = false;
+	auto writePages  = [&](bool a_flush) {
+		if(a_flush) { packer.Flush(); }
+		std::span<const unsigned char> page;
+		while(packer.NextPage(page)) {
+			if(!outputFile.Write(page.data(), page.size())) { writeFailed = true; }
+		}
+	};
+
+	// header and comment packets each get their own page, same as libopusenc.
+	const std::vector<unsigned char> header =
+	    cea::BuildOpusHead(c_numOutputChannels, a_state.preskip, a_flacInfo.sampleRate);
+	const std::vector<unsigned char> comments = cea::BuildOpusTags(a_flacInfo.comments, 512);
+	if(comments.empty()) {
+		AddError("Out of memory building the tags for {}", a_dest.string());
+		return false;
+	}
+	if(!packer.AddPacket(header, 0, false)) {
+		AddError("Out of memory writing the header of {}", a_dest.string());
+		return false;
+	}
+	writePages(true);
+	if(!packer.AddPacket(comments, 0, false)) {
+		AddError("Out of memory writing the tags of {}", a_dest.string());
+		return false;
+	}
+	writePages(true);
+
+	const uint64_t finalGranule = a_state.outputFrames + a_state.preskip;
+	uint64_t granule            = 0;
+	for(const auto& segment : a_state.segments) {
+		const unsigned char* segmentData = segment.packetData.data();
+		for(size_t i = 0; i < segment.packetSizes.size(); ++i) {
+			granule += c_opusFrameSize;
+			bool endOfStream = granule >= finalGranule;
+			if(!packer.AddPacket({segmentData, (size_t)segment.packetSizes[i]},
+			                     std::min(granule, finalGranule), endOfStream)) {
+				AddError("Out of memory writing {}", a_dest.string());
+				return false;
 			}
-			break;
-		default:
-			AddError("{} had an usupported number of channels {}", job.source.string(),
-			         flacInfo.numChannels);
-			return;
-			break;
+			segmentData += segment.packetSizes[i];
+			writePages(endOfStream);
+		}
 	}
+	writePages(true);
 
-	if(CancelWork.load()) { return; }
+	if(writeFailed || !outputFile.Commit()) {
+		AddError("Failed to write data to opus encoder. {}", ope_strerror(OPE_WRITE_FAIL));
+		return false;
+	}
+	return true;
+}
 
-	constexpr uint32_t c_targetSampleRate = 48000;
+// about one segment per worker, rounded up to whole seconds.
+uint64_t SegmentFrames(uint64_t a_outputFrames, uint32_t a_numWorkers) {
+	uint64_t segmentFrames = std::max(c_minSegmentFrames, a_outputFrames / a_numWorkers);
+	segmentFrames = (segmentFrames + c_targetSampleRate - 1) / c_targetSampleRate;
+	return segmentFrames * c_targetSampleRate;
+}
 
-	uint64_t outputFrames = flacInfo.numFrames;
-	if(flacInfo.sampleRate != c_targetSampleRate) {
-		outputFrames = ((uint64_t)flacInfo.numFrames * c_targetSampleRate) / flacInfo.sampleRate;
-		nextBuffer();
-		currentBuffer().prepare(outputFrames * numOutputChannels);
-		auto srcPtr  = workingBuffer().data();
-		auto destPtr = currentBuffer().data();
+bool ConvertFileSegmented(const ConversionJob& job, cep::MemoryMappedFile& sourceFile,
+                          const FlacInfo& flacInfo, uint64_t outputFrames, uint32_t numWorkers) {
+	const uint64_t segmentFrames = SegmentFrames(outputFrames, numWorkers);
+	auto numSegments = (uint32_t)((outputFrames + segmentFrames - 1) / segmentFrames);
+
+	auto state           = std::make_shared<SegmentedEncode>(numSegments);
+	state->sourceFile    = &sourceFile;
+	state->flacInfo      = &flacInfo;
+	state->profile       = job.profile;
+	state->source        = job.source;
+	state->outputFrames  = outputFrames;
+	state->segmentFrames = segmentFrames;
+	{
+		int error{};
+		OpusEncoder* encoder = opus_encoder_create(c_targetSampleRate, c_numOutputChannels,
+		                                           OPUS_APPLICATION_AUDIO, &error);
+		if(encoder == nullptr) {
+			AddError("Failed to created opus encoder. {}", opus_strerror(error));
+			return false;
+		}
+		ConfigureOpusEncoder(encoder, *job.profile);
+		opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&state->preskip));
+		opus_encoder_destroy(encoder);
+	}
 
-		SRC_DATA srcData;
-		srcData.end_of_input  = 0;
-		srcData.src_ratio     = static_cast<double>(c_targetSampleRate) / flacInfo.sampleRate;
-		srcData.data_in       = srcPtr;
-		srcData.input_frames  = flacInfo.numFrames;
-		srcData.data_out      = destPtr;
-		srcData.output_frames = (uint32_t)outputFrames;
+	// this worker encodes segments too, so nothing deadlocks if the other workers are all busy.
+	// Helpers go ahead of the other queued files so the next free workers join in, this track was
+	// queued first for being long.
+	for(uint32_t i = 1; i < std::min(numSegments, numWorkers); ++i) {
+		QueueWorkNext([state]() { EncodeSegments(*state); });
+	}
+	EncodeSegments(*state);
+	state->segmentsDone.wait();
 
-		uint32_t filterQuality = SRC_SINC_BEST_QUALITY;
-#if CR_DEBUG
-		filterQuality = SRC_LINEAR;
-#endif
+	if(state->failed.load() || CancelWork.load()) { return false; }
 
-		int error = src_simple(&srcData, filterQuality, 2);
-		if(error != 0) {
-			AddError("error converted sample rate {}", src_strerror(error));
-			return;
+	// OutputFile cleans up after itself if this fails.
+	return WriteSegmentedOpus(job.dest, flacInfo, *state);
+}
+
+// Pulls everything out of a_pcm into a_encoder, a block at a time.
+template<typename SampleT>
+bool EncodeStream(PcmStream& a_pcm, OggOpusEnc* a_encoder) {
+	cecore::StorageBuffer<SampleT> encodeBuffer;
+	encodeBuffer.prepare(c_blockFrames * c_numOutputChannels);
+
+	while(true) {
+		uint32_t numFrames = a_pcm.Read(encodeBuffer.data(), c_blockFrames);
+		if(numFrames == 0) { break; }
+		int32_t writeError{};
+		if constexpr(std::is_same_v<SampleT, int16_t>) {
+			writeError = ope_encoder_write(a_encoder, encodeBuffer.data(), (int)numFrames);
+		} else {
+			writeError = ope_encoder_write_float(a_encoder, encodeBuffer.data(), (int)numFrames);
+		}
+		if(writeError != OPE_OK) {
+			AddError("Failed to write data to opus encoder. {}", ope_strerror(writeError));
+			return false;
 		}
-		currentBuffer().commit(outputFrames * numOutputChannels);
 	}
+	return !a_pcm.Failed();
+}
+
+struct FlacStreamInfo {
+	uint32_t sampleRate{};
+	uint32_t numChannels{};
+	// 0 if the encoder didn't know.
+	uint64_t numFrames{};
+	// all 0 if the encoder left it unset.
+	cea::Md5Digest md5{};
+};
+
+// STREAMINFO is always the first metadata block, so it is at a fixed offset and the rest of the
+// file doesn't need to be read.
+std::optional<FlacStreamInfo> ReadFlacStreamInfo(const fs::path& a_path) {
+	// "fLaC", metadata block header, block and frame sizes, then sample rate, channels, bits per
+	// sample and frame count packed into 64 bits, then the MD5.
+	constexpr size_t c_packedOffset = 4 + 4 + 10;
+	constexpr size_t c_md5Offset    = c_packedOffset + 8;
+	std::array<std::byte, c_md5Offset + sizeof(cea::Md5Digest)> header;
+
+	cecore::FileHandle file(a_path, false);
+	if(file.asFile() == nullptr ||
+	   std::fread(header.data(), 1, header.size(), file.asFile()) != header.size()) {
+		return std::nullopt;
+	}
+	// block type is the low 7 bits, STREAMINFO is 0
+	if(std::memcmp(header.data(), "fLaC", 4) != 0 || ((uint8_t)header[4] & 0x7f) != 0) {
+		return std::nullopt;
+	}
+	uint64_t packed{};
+	for(size_t i = 0; i < 8; ++i) { packed = (packed << 8) | (uint8_t)header[c_packedOffset + i]; }
+
+	FlacStreamInfo info;
+	info.sampleRate  = (uint32_t)(packed >> 44);
+	info.numChannels = (uint32_t)((packed >> 41) & 0x7) + 1;
+	info.numFrames   = packed & 0xf'ffff'ffffull;
+	std::memcpy(info.md5.data(), header.data() + c_md5Offset, info.md5.size());
+	return info;
+}
 
-	if(CancelWork.load()) { return; }
+// Empty if the encoder left it unset.
+std::optional<cea::Md5Digest> ReadFlacMd5(const fs::path& a_path) {
+	auto info = ReadFlacStreamInfo(a_path);
+	if(!info || info->md5 == cea::Md5Digest{}) { return std::nullopt; }
+	return info->md5;
+}
+
+// For ConversionJob::cost. Falls back to about one channel sample per byte of flac if the frame
+// count isn't in STREAMINFO.
+uint64_t ConvertCost(const fs::path& a_source, uint64_t a_size) {
+	auto info = ReadFlacStreamInfo(a_source);
+	if(!info || info->numFrames == 0) { return a_size; }
+	return info->numFrames * info->numChannels;
+}
+
+// Returns the content id of the source if the output was written.
+std::optional<cea::Md5Digest> ConvertFile(const ConversionJob& job) {
+	if(CancelWork.load()) { return std::nullopt; }
+
+	if(!fs::exists(job.source)) {
+		AddError("{} doesn't exist, logic error in app", job.source.string());
+		return std::nullopt;
+	}
+
+	cep::MemoryMappedFile sourceFile(job.source);
+	if(!sourceFile.isValid()) {
+		AddError("{} could not be read, or is empty", job.source.string());
+		return std::nullopt;
+	}
+	// decoded front to back, except for segmented encodes which each go front to back over their
+	// own part. Either way the OS can read well ahead of the decoder.
+	sourceFile.SetAccessHint(cep::MemoryMappedFile::AccessHint::Sequential);
+
+	FlacInfo flacInfo{};
+
+	MappedFlacStream flacStream{&sourceFile, &flacInfo};
+	auto drFlac = OpenFlac(flacStream);
+	if(drFlac == nullptr) {
+		AddError("{} could not be opened as a flac file", job.source.string());
+		return std::nullopt;
+	}
+	auto closeFlac = cecore::defer([&] { drflac_close(drFlac); });
+
+	if(flacInfo.numFrames == 0) {
+		AddError("{} could not read flac uncompressed size", job.source.string());
+		return std::nullopt;
+	}
+	if(cea::GetDownmixMatrix(flacInfo.numChannels) == nullptr) {
+		AddError("{} had an usupported number of channels {}", job.source.string(),
+		         flacInfo.numChannels);
+		return std::nullopt;
+	}
+
+	if(CancelWork.load()) { return std::nullopt; }
+
+	const uint64_t outputFrames =
+	    (flacInfo.numFrames * c_targetSampleRate + flacInfo.sampleRate - 1) / flacInfo.sampleRate;
+	const auto numWorkers = (uint32_t)workerThreads.size();
+	if(outputFrames >= c_parallelEncodeMinFrames && numWorkers > 1) {
+		if(!ConvertFileSegmented(job, sourceFile, flacInfo, outputFrames, numWorkers)) {
+			return std::nullopt;
+		}
+		return flacInfo.md5;
+	}
 
 	OggOpusComments* opusComments = ope_comments_create();
 
@@ -434,162 +1385,1040 @@ void ConvertFile(const ConversionJob& job) {
 		ope_comments_add_string(opusComments, comment.c_str());
 	}
 
-	int32_t error{};
-	OggOpusEnc* encoder = ope_encoder_create_file(job.dest.string().c_str(), opusComments,
-	                                              c_targetSampleRate, 2, 0, &error);
-	if(encoder == nullptr) {
-		AddError("Failed to created opus encoder. {}", ope_strerror(error));
-		ope_comments_destroy(opusComments);
-		return;
+	// bitrate is a target, so leave some room over it.
+	const uint64_t estimatedSize =
+	    outputFrames * job.profile->bitrate / 8 / c_targetSampleRate * 11 / 10 + 64 * 1024;
+	OutputFile outputFile(job.dest, estimatedSize);
+	const OpusEncCallbacks callbacks{OutputFile::WriteCallback, OutputFile::CloseCallback};
+
+	int32_t error{};
+	OggOpusEnc* encoder = ope_encoder_create_callbacks(&callbacks, &outputFile, opusComments,
+	                                                   c_targetSampleRate, 2, 0, &error);
+	if(encoder == nullptr) {
+		AddError("Failed to created opus encoder. {}", ope_strerror(error));
+		ope_comments_destroy(opusComments);
+		return std::nullopt;
+	}
+
+	ope_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(job.profile->complexity));
+	ope_encoder_ctl(encoder, OPUS_SET_BITRATE(job.profile->bitrate));
+
+	PcmStream pcm(drFlac, flacInfo, flacInfo.numFrames, job.profile->resampler);
+	pcm.ReleaseConsumed(flacStream);
+	bool failed = pcm.SupportsInteger() ? !EncodeStream<int16_t>(pcm, encoder) :
+	                                      !EncodeStream<float>(pcm, encoder);
+
+	if(!failed && pcm.FramesDecoded() != flacInfo.numFrames) {
+		AddError("{} was shorter than expected, corrupted data?", job.source.string());
+	}
+
+	// done anyway, just fall through and clean up.
+	if(ope_encoder_drain(encoder) != OPE_OK) { failed = true; }
+	ope_encoder_destroy(encoder);
+	ope_comments_destroy(opusComments);
+
+	// if this doesn't happen, OutputFile removes the temp file, and the old output if there was one
+	// stays as it was.
+	if(failed) { return std::nullopt; }
+	if(!outputFile.Commit()) {
+		AddError("Failed to write data to opus encoder. {}", ope_strerror(OPE_WRITE_FAIL));
+		return std::nullopt;
+	}
+	return flacInfo.md5;
+}
+
+// Ogg page checksum. CRC-32 with polynomial 0x04c11db7, not reflected, over the whole page with
+// the checksum field set to 0.
+uint32_t OggChecksum(std::span<const std::byte> a_page) {
+	static const auto c_table = [] {
+		std::array<uint32_t, 256> table;
+		for(uint32_t i = 0; i < 256; ++i) {
+			uint32_t crc = i << 24;
+			for(int bit = 0; bit < 8; ++bit) { crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0); }
+			table[i] = crc;
+		}
+		return table;
+	}();
+	uint32_t crc = 0;
+	for(std::byte value : a_page) { crc = (crc << 8) ^ c_table[(crc >> 24) ^ (uint8_t)value]; }
+	return crc;
+}
+
+struct OggPage {
+	size_t offset{};
+	size_t headerSize{};
+	size_t bodySize{};
+	uint8_t flags{};
+	// lacing values, in the header
+	std::span<const std::byte> segments;
+};
+
+constexpr size_t c_oggFixedHeaderSize  = 27;
+constexpr size_t c_oggGranuleOffset    = 6;
+constexpr size_t c_oggSequenceOffset   = 18;
+constexpr size_t c_oggChecksumOffset   = 22;
+constexpr uint8_t c_oggContinuedFlag   = 0x01;
+constexpr uint8_t c_oggEndOfStreamFlag = 0x04;
+// granule of a page that no packet finishes on.
+constexpr uint64_t c_oggNoGranule = ~0ull;
+
+// false if there isn't a whole page at a_offset.
+bool ReadOggPage(std::span<const std::byte> a_data, size_t a_offset, OggPage& a_page) {
+	if(a_data.size() - a_offset < c_oggFixedHeaderSize ||
+	   std::memcmp(a_data.data() + a_offset, "OggS", 4) != 0) {
+		return false;
+	}
+	const size_t numSegments = (uint8_t)a_data[a_offset + c_oggFixedHeaderSize - 1];
+	if(a_data.size() - a_offset < c_oggFixedHeaderSize + numSegments) { return false; }
+
+	a_page.offset     = a_offset;
+	a_page.headerSize = c_oggFixedHeaderSize + numSegments;
+	a_page.flags      = (uint8_t)a_data[a_offset + 5];
+	a_page.segments   = a_data.subspan(a_offset + c_oggFixedHeaderSize, numSegments);
+	a_page.bodySize   = 0;
+	for(std::byte lacing : a_page.segments) { a_page.bodySize += (uint8_t)lacing; }
+	return a_data.size() - a_offset - a_page.headerSize >= a_page.bodySize;
+}
+
+// Copies a_page into a_out with its sequence number moved by a_sequenceDelta, and a_body in place
+// of its body if given, which has to be the same size. Checksum is redone.
+void RewriteOggPage(std::span<const std::byte> a_data, const OggPage& a_page,
+                    int32_t a_sequenceDelta, std::span<const std::byte> a_body,
+                    std::vector<std::byte>& a_out) {
+	a_out.assign(a_data.begin() + a_page.offset,
+	             a_data.begin() + a_page.offset + a_page.headerSize + a_page.bodySize);
+	if(!a_body.empty()) { std::ranges::copy(a_body, a_out.begin() + a_page.headerSize); }
+
+	uint32_t sequence{};
+	std::memcpy(&sequence, a_out.data() + c_oggSequenceOffset, sizeof(sequence));
+	sequence += a_sequenceDelta;
+	std::memcpy(a_out.data() + c_oggSequenceOffset, &sequence, sizeof(sequence));
+
+	uint32_t checksum{};
+	std::memcpy(a_out.data() + c_oggChecksumOffset, &checksum, sizeof(checksum));
+	checksum = OggChecksum(a_out);
+	std::memcpy(a_out.data() + c_oggChecksumOffset, &checksum, sizeof(checksum));
+}
+
+// For when only the tags of job.source changed, puts its comments into the OpusTags packet of the
+// existing output instead of encoding it again. If the new tags fit in the old packet, its padding
+// included, only those pages are rewritten, in place. Otherwise the file is copied with a new tags
+// packet and the later pages renumbered, still no audio work either way. Returns the content id
+// of the source if it worked. If the output isn't laid out the way libopusenc writes it, or the
+// audio no longer matches job.record, returns nothing and the caller should convert instead.
+std::optional<cea::Md5Digest> RetagFile(const ConversionJob& job) {
+	if(CancelWork.load()) { return std::nullopt; }
+
+	// converting it instead reports the error, for either of these.
+	if(!fs::exists(job.source)) { return std::nullopt; }
+	FlacInfo flacInfo{};
+	{
+		cep::MemoryMappedFile sourceFile(job.source);
+		if(!sourceFile.isValid()) { return std::nullopt; }
+		// only the metadata at the start is read, reading ahead into the audio would be wasted.
+		sourceFile.SetAccessHint(cep::MemoryMappedFile::AccessHint::Random);
+		MappedFlacStream flacStream{&sourceFile, &flacInfo};
+		drflac* drFlac = OpenFlac(flacStream);
+		if(drFlac == nullptr) { return std::nullopt; }
+		drflac_close(drFlac);
+	}
+	if(flacInfo.md5 != job.record.ContentId || flacInfo.md5 == cea::Md5Digest{}) {
+		return std::nullopt;
+	}
+	std::vector<unsigned char> newComments = cea::BuildOpusTags(flacInfo.comments, 0);
+	if(newComments.empty()) { return std::nullopt; }
+
+	std::optional<cep::MemoryMappedFile> destFile(std::in_place, job.dest);
+	if(!destFile->isValid()) { return std::nullopt; }
+	const std::span<const std::byte> data = destFile->GetData();
+
+	// OpusHead on the first page, then OpusTags on its own page or pages, ending the last one.
+	OggPage headPage;
+	if(!ReadOggPage(data, 0, headPage) || headPage.bodySize < 8 ||
+	   std::memcmp(data.data() + headPage.headerSize, "OpusHead", 8) != 0) {
+		return std::nullopt;
+	}
+	std::vector<OggPage> tagPages;
+	size_t oldCommentsSize = 0;
+	size_t offset          = headPage.headerSize + headPage.bodySize;
+	for(bool packetDone = false; !packetDone;) {
+		OggPage page;
+		if(!ReadOggPage(data, offset, page) || page.segments.empty()) { return std::nullopt; }
+		if(tagPages.empty() && ((page.flags & c_oggContinuedFlag) || page.bodySize < 8 ||
+		                        std::memcmp(data.data() + page.headerSize + offset, "OpusTags", 8))) {
+			return std::nullopt;
+		}
+		// a lacing value under 255 ends the packet, it has to be the last one on the page.
+		for(size_t i = 0; i < page.segments.size(); ++i) {
+			if((uint8_t)page.segments[i] < 255) {
+				if(i + 1 != page.segments.size()) { return std::nullopt; }
+				packetDone = true;
+			}
+		}
+		oldCommentsSize += page.bodySize;
+		offset += page.headerSize + page.bodySize;
+		tagPages.push_back(page);
+	}
+	const size_t audioOffset = offset;
+
+	std::vector<std::byte> pageBuffer;
+	if(newComments.size() <= oldCommentsSize) {
+		// same size means the same lacing, so the pages keep their layout and only need new bodies.
+		newComments.resize(oldCommentsSize, 0);
+		std::vector<std::pair<size_t, std::vector<std::byte>>> newPages;
+		size_t commentsOffset = 0;
+		for(const auto& page : tagPages) {
+			auto body = std::as_bytes(std::span(newComments)).subspan(commentsOffset, page.bodySize);
+			RewriteOggPage(data, page, 0, body, pageBuffer);
+			newPages.emplace_back(page.offset, pageBuffer);
+			commentsOffset += page.bodySize;
+		}
+		// windows won't open it for writing while it is mapped.
+		destFile.reset();
+
+		// this can't be done through a temp file, if it is interrupted the next run has to know the
+		// output may be half written.
+		JournalBegin(job, true);
+		std::fstream file(job.dest, std::ios::in | std::ios::out | std::ios::binary);
+		for(const auto& [pageOffset, page] : newPages) {
+			file.seekp((std::streamoff)pageOffset);
+			file.write((const char*)page.data(), (std::streamsize)page.size());
+		}
+		file.flush();
+		if(!file) {
+			AddError("Failed to update tags of {}", job.dest.string());
+			return std::nullopt;
+		}
+		return flacInfo.md5;
+	}
+
+	uint32_t serial{};
+	std::memcpy(&serial, data.data() + 14, sizeof(serial));
+	cea::OggPacker packer(serial);
+	if(!packer.isValid()) { return std::nullopt; }
+
+	// goes to <dest>.partial like a conversion, so the journal needs to know about it the same way.
+	JournalBegin(job, false);
+	OutputFile outputFile(job.dest, data.size() + newComments.size() + 512);
+	bool writeFailed = !outputFile.Write((const unsigned char*)data.data(),
+	                                     headPage.headerSize + headPage.bodySize);
+
+	// the packer numbers pages from 0, run the head through it first so the tags get the right
+	// numbers, but keep the original head page.
+	const std::span<const unsigned char> head{
+	    (const unsigned char*)data.data() + headPage.headerSize, headPage.bodySize};
+	if(!packer.AddPacket(head, 0, false)) { return std::nullopt; }
+	packer.Flush();
+	std::span<const unsigned char> page;
+	while(packer.NextPage(page)) {}
+
+	// new comments get padding too, so the next retag of this file can be done in place.
+	newComments = cea::BuildOpusTags(flacInfo.comments, 512);
+	if(newComments.empty() || !packer.AddPacket(newComments, 0, false)) { return std::nullopt; }
+	packer.Flush();
+	int32_t newTagPages = 0;
+	while(packer.NextPage(page)) {
+		if(!outputFile.Write(page.data(), page.size())) { writeFailed = true; }
+		++newTagPages;
+	}
+
+	const int32_t sequenceDelta = newTagPages - (int32_t)tagPages.size();
+	for(offset = audioOffset; offset < data.size() && !writeFailed;) {
+		OggPage audioPage;
+		if(!ReadOggPage(data, offset, audioPage)) {
+			AddError("{} is damaged, converting it again", job.dest.string());
+			return std::nullopt;
+		}
+		RewriteOggPage(data, audioPage, sequenceDelta, {}, pageBuffer);
+		if(!outputFile.Write((const unsigned char*)pageBuffer.data(), pageBuffer.size())) {
+			writeFailed = true;
+		}
+		offset += audioPage.headerSize + audioPage.bodySize;
+	}
+
+	// windows won't rename over it while it is mapped.
+	destFile.reset();
+	if(writeFailed || !outputFile.Commit()) {
+		AddError("Failed to update tags of {}", job.dest.string());
+		return std::nullopt;
+	}
+	return flacInfo.md5;
+}
+
+// What planning needs to know about one file or directory in a tree.
+struct TreeEntry {
+	bool isDirectory{};
+	uint64_t size{};
+	fs::file_time_type lastWriteTime{};
+};
+
+// keyed by path relative to the root of the tree
+using TreeIndex = std::unordered_map<fs::path, TreeEntry, cea::PathHash>;
+
+int64_t ToManifestTime(fs::file_time_type a_time) {
+	return a_time.time_since_epoch().count();
+}
+
+fs::file_time_type FromManifestTime(int64_t a_time) {
+	return fs::file_time_type{fs::file_time_type::duration{a_time}};
+}
+
+// Directory listing is mostly waiting on the filesystem, particularly on a NAS, so walk with more
+// threads than there are cores. These are short lived and only exist while nothing is queued for
+// the workers.
+uint32_t WalkThreadCount() { return (uint32_t)std::max<size_t>(workerThreads.size(), 8); }
+
+// Walks a_root once. Directory entries already know their type, so the only other filesystem
+// calls are for the size and write time of regular files. Anything else, like broken links or a
+// file deleted during the walk, is left out. Empty if a directory couldn't be listed, the error
+// log says which.
+std::optional<TreeIndex> IndexTree(const fs::path& a_root) {
+	const uint32_t numThreads = WalkThreadCount();
+	std::vector<TreeIndex> threadIndexes(numThreads);
+	auto walkError = cea::WalkDirectory(
+	    a_root, numThreads,
+	    [&](uint32_t a_thread, const fs::directory_entry& a_entry, const fs::path& a_relPath) {
+		    std::error_code ec;
+		    TreeEntry treeEntry;
+		    treeEntry.isDirectory = a_entry.is_directory(ec);
+		    if(ec) { return; }
+		    if(!treeEntry.isDirectory) {
+			    if(!a_entry.is_regular_file(ec)) { return; }
+			    treeEntry.size          = a_entry.file_size(ec);
+			    treeEntry.lastWriteTime = a_entry.last_write_time(ec);
+			    if(ec) { return; }
+		    }
+		    threadIndexes[a_thread].emplace(a_relPath, treeEntry);
+	    });
+	if(walkError) {
+		AddError("Failed to list {}. error {}", walkError->Path.string(), walkError->Error.message());
+		return std::nullopt;
+	}
+
+	TreeIndex index = std::move(threadIndexes[0]);
+	for(uint32_t i = 1; i < numThreads; ++i) { index.merge(threadIndexes[i]); }
+	return index;
+}
+
+// The destination as the manifest says the last run left it, without touching the disk. Outputs
+// get the write time of the source they were made from, so the usual newer than check still finds
+// sources that changed since.
+TreeIndex IndexFromManifest(const cea::SyncManifest& a_manifest) {
+	TreeIndex index;
+	index.reserve(a_manifest.Entries.size());
+	for(const auto& [relPath, entry] : a_manifest.Entries) {
+		index.emplace(entry.Output,
+		              TreeEntry{entry.IsDirectory, entry.Size, FromManifestTime(entry.LastWriteTime)});
+	}
+	return index;
+}
+
+using ChangedPaths = std::unordered_set<fs::path, cea::PathHash>;
+
+// The source as the manifest has it, except for a_changed and everything under them, which are
+// looked at again. A changed directory that can't be listed is left as the manifest has it, rather
+// than looking empty and having everything converted from it deleted. The error log says which,
+// and the next sync that gets to list it picks up whatever changed.
+TreeIndex IndexChangedSource(const cea::SyncManifest& a_manifest, const ChangedPaths& a_changed) {
+	std::unordered_map<fs::path, TreeIndex, cea::PathHash> listed;
+	ChangedPaths unlisted;
+	for(const auto& relPath : a_changed) {
+		std::error_code ec;
+		const fs::directory_entry entry(sourcePath / relPath, ec);
+		if(ec || !entry.is_directory(ec)) { continue; }
+		if(std::optional<TreeIndex> children = IndexTree(entry.path())) {
+			listed.emplace(relPath, std::move(*children));
+		} else {
+			unlisted.insert(relPath);
+		}
+	}
+
+	auto isChanged = [&](fs::path a_relPath) {
+		for(; !a_relPath.empty(); a_relPath = a_relPath.parent_path()) {
+			if(a_changed.contains(a_relPath)) { return !unlisted.contains(a_relPath); }
+		}
+		return false;
+	};
+
+	TreeIndex index;
+	index.reserve(a_manifest.Entries.size());
+	for(const auto& [relPath, entry] : a_manifest.Entries) {
+		if(isChanged(relPath)) { continue; }
+		index.emplace(relPath,
+		              TreeEntry{entry.IsDirectory, entry.Size, FromManifestTime(entry.LastWriteTime)});
+	}
+
+	for(const auto& relPath : a_changed) {
+		if(unlisted.contains(relPath)) { continue; }
+		if(auto children = listed.find(relPath); children != listed.end()) {
+			index.insert_or_assign(relPath, TreeEntry{.isDirectory = true});
+			for(auto& [childPath, childEntry] : children->second) {
+				index.insert_or_assign(relPath / childPath, childEntry);
+			}
+		} else {
+			std::error_code ec;
+			const fs::directory_entry entry(sourcePath / relPath, ec);
+			if(ec || !entry.is_regular_file(ec)) { continue; }
+			const uint64_t size = entry.file_size(ec);
+			if(ec) { continue; }
+			const fs::file_time_type lastWriteTime = entry.last_write_time(ec);
+			if(ec) { continue; }
+			index.insert_or_assign(relPath, TreeEntry{false, size, lastWriteTime});
+		}
+		// a new folder may not be in the manifest yet.
+		for(fs::path parent = relPath.parent_path(); !parent.empty(); parent = parent.parent_path()) {
+			if(!index.try_emplace(parent, TreeEntry{.isDirectory = true}).second) { break; }
+		}
 	}
+	return index;
+}
 
-#if CR_DEBUG
-	ope_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(0));
-#else
-	ope_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(10));
-#endif
-	ope_encoder_ctl(encoder, OPUS_SET_BITRATE(256 * 1024));
+void RecordOutput(const fs::path& a_relPath, cea::ManifestEntry a_entry) {
+	if(journal) { journal->Complete(a_relPath, a_entry); }
+	std::scoped_lock lock(manifestMutex);
+	pendingManifest.Entries.insert_or_assign(a_relPath, std::move(a_entry));
+}
 
-	error = ope_encoder_write_float(encoder, currentBuffer().data(), (uint32_t)outputFrames);
-	if(error != OPE_OK) {
-		AddError("Failed to write data to opus encoder. {}", ope_strerror(error));
-		// done anyway, just fall through and clean up.
+// Only once no workers are running anything from the run. The journal goes once the manifest has
+// everything it had.
+void SavePendingManifest() {
+	std::scoped_lock lock(manifestMutex);
+	if(!manifestPending) { return; }
+	manifestPending = false;
+	std::error_code ec;
+	if(!cea::SaveManifest(c_manifestPath, pendingManifest)) {
+		AddError("Failed to save {}, next run will walk the destination", c_manifestPath.string());
+		fs::remove(c_manifestPath, ec);
 	}
+	pendingManifest = {};
+	journal.reset();
+	fs::remove(c_journalPath, ec);
+}
 
-	ope_encoder_drain(encoder);
-	ope_encoder_destroy(encoder);
-	ope_comments_destroy(opusComments);
+// Keeps the computer from going to sleep in the middle of a run, call at the start of each long
+// job. Nothing to do on linux, encode boxes there don't sleep.
+void KeepSystemAwake() {
+#if defined(_WIN32)
+	SetThreadExecutionState(ES_SYSTEM_REQUIRED);
+#endif
 }
 
 void FinishedJob() {
-	++completedJobs;
-	convertProgress = (float)completedJobs / numJobs;
+	int32_t completed = ++completedJobs;
+	convertProgress.store((float)completed / numJobs.load());
 }
 
-void StartConversion() {
-	ClearErrorLog();
-	CancelWork.store(false);
+bool PrepareRoots() {
 	sourcePath = sourcePathString;
 	destPath   = destPathString;
 	if(!fs::exists(sourcePath)) {
 		AddError("Source Path {} doesn't exist", sourcePath.string());
-		return;
+		return false;
 	}
 	if(!fs::exists(destPath)) {
 		AddError("Destination Path {} doesn't exist", destPath.string());
-		return;
+		return false;
+	}
+	return true;
+}
+
+// Only if it was made for the current roots. If the last run was interrupted this includes what
+// it got done, from its journal, as long as FinishInterruptedRun hasn't dealt with it yet.
+std::optional<cea::SyncManifest> LoadCurrentManifest() {
+	std::optional<cea::SyncManifest> manifest = cea::LoadManifest(c_manifestPath);
+	if(manifest && (manifest->SourceRoot != sourcePath || manifest->DestRoot != destPath)) {
+		manifest.reset();
+	}
+	std::vector<cea::UnfinishedOutput> unfinished;
+	if(manifest) { cea::ReplayJournal(c_journalPath, *manifest, unfinished); }
+	return manifest;
+}
+
+// A journal left behind means the last run was interrupted. Everything it finished goes into the
+// manifest, so this run only has what is left to do, and whatever it was in the middle of is
+// cleaned up so it gets done again.
+void FinishInterruptedRun() {
+	if(!fs::exists(c_journalPath)) { return; }
+
+	std::optional<cea::SyncManifest> manifest = cea::LoadManifest(c_manifestPath);
+	// without the manifest it started from the journal can't be applied to anything, but it still
+	// says what was left half done.
+	const bool haveManifest =
+	    manifest && manifest->SourceRoot == sourcePath && manifest->DestRoot == destPath;
+	if(!haveManifest) {
+		manifest = cea::SyncManifest{.SourceRoot = sourcePath, .DestRoot = destPath, .Entries = {}};
+	}
+	std::vector<cea::UnfinishedOutput> unfinished;
+	if(cea::ReplayJournal(c_journalPath, *manifest, unfinished)) {
+		AddError("Last run was interrupted, continuing from where it stopped");
+		std::error_code ec;
+		for(const auto& output : unfinished) {
+			fs::remove(fs::path(destPath / output.Output) += ".partial", ec);
+			if(output.InPlace) { fs::remove(destPath / output.Output, ec); }
+		}
+		if(haveManifest && !cea::SaveManifest(c_manifestPath, *manifest)) {
+			AddError("Failed to save {}, next run will walk the destination", c_manifestPath.string());
+			fs::remove(c_manifestPath, ec);
+		}
 	}
+	std::error_code ec;
+	fs::remove(c_journalPath, ec);
+}
+
+// Everything a sync will do, worked out before anything in the destination is touched.
+struct SyncPlan {
+	std::vector<fs::path> filesToDelete;
+	std::vector<fs::path> pathsToDelete;
+	// manifest records to drop once the deletes are done.
+	std::vector<fs::path> staleRecords;
+	std::vector<fs::path> pathsToAdd;
+	std::vector<fs::path> recordsToAdd;
+	std::vector<MoveJob> pathsToMove;
+	std::vector<ConversionJob> pathsToCopy;
+	std::vector<ConversionJob> pathsToRetag;
+	std::vector<ConversionJob> pathsToConvert;
+	// what is already up to date, the run records everything else as it is done.
+	cea::SyncManifest manifest;
+};
+
+// Works out everything needed to make the destination match sourceIndex, without changing
+// anything. destIndex is what is in the destination now, manifest is the one from the last run if
+// there is one. incremental means destIndex came from that manifest rather than the disk.
+SyncPlan PlanSync(const TreeIndex& sourceIndex, const TreeIndex& destIndex,
+                  const std::optional<cea::SyncManifest>& manifest, bool incremental) {
+	// Everything already up to date goes straight into the new manifest, keeping what the old one
+	// knew about it if the source hasn't changed since.
+	cea::SyncManifest newManifest{.SourceRoot = sourcePath, .DestRoot = destPath, .Entries = {}};
+	auto makeRecord = [&](const fs::path& a_relPath, const TreeEntry& a_entry,
+	                      const fs::path& a_output) {
+		cea::ManifestEntry record{.IsDirectory   = a_entry.isDirectory,
+		                          .Size          = a_entry.size,
+		                          .LastWriteTime = ToManifestTime(a_entry.lastWriteTime),
+		                          .ContentId     = {},
+		                          .Output        = a_output,
+		                          .Profile       = {}};
+		if(manifest) {
+			auto old = manifest->Entries.find(a_relPath);
+			if(old != manifest->Entries.end() && old->second.Output == a_output &&
+			   old->second.Size == record.Size && old->second.LastWriteTime == record.LastWriteTime) {
+				record.ContentId = old->second.ContentId;
+				record.Profile   = old->second.Profile;
+			}
+		}
+		return record;
+	};
 
 	// First lets delete any directories/files in dest that aren't in source
 	std::vector<fs::path> pathsToDelete;
 	std::vector<fs::path> filesToDelete;
-	for(const auto& entry : fs::recursive_directory_iterator(destPath)) {
-		if(entry.is_directory()) {
-			auto relPath     = fs::relative(entry.path(), destPath);
-			auto pathToCheck = sourcePath / relPath;
-			if(!fs::exists(pathToCheck)) { pathsToDelete.push_back(entry.path()); }
-		} else if(entry.is_regular_file()) {
-			auto relPath     = fs::relative(entry.path(), destPath);
-			auto pathToCheck = sourcePath / relPath;
-			if(entry.path().extension() == ".ogg") {
-				// If it was copied or converted keep it
-				auto pathToCheck2 = pathToCheck;
-				pathToCheck2.replace_extension(".flac");
-				if(!fs::exists(pathToCheck) && !fs::exists(pathToCheck2)) {
-					filesToDelete.push_back(entry.path());
-				}
-			} else if(isPathToCopy(entry.path())) {
-				if(!fs::exists(pathToCheck)) { filesToDelete.push_back(entry.path()); }
-			} else {
-				filesToDelete.push_back(entry.path());
+	for(const auto& [relPath, entry] : destIndex) {
+		// anything inside a directory that is being deleted goes with it.
+		if(relPath.has_parent_path() && !sourceIndex.contains(relPath.parent_path())) { continue; }
+
+		if(entry.isDirectory) {
+			if(!sourceIndex.contains(relPath)) { pathsToDelete.push_back(destPath / relPath); }
+		} else if(HasExtension(relPath, ".ogg")) {
+			// If it was copied or converted keep it
+			auto flacPath = relPath;
+			flacPath.replace_extension(".flac");
+			if(!sourceIndex.contains(relPath) && !sourceIndex.contains(flacPath)) {
+				filesToDelete.push_back(destPath / relPath);
 			}
+		} else if(isPathToCopy(relPath)) {
+			if(!sourceIndex.contains(relPath)) { filesToDelete.push_back(destPath / relPath); }
+		} else {
+			filesToDelete.push_back(destPath / relPath);
 		}
 	}
-
-	// Now add any missing folders
-	std::vector<fs::path> pathsToAdd;
-	for(const auto& entry : fs::recursive_directory_iterator(sourcePath)) {
-		if(entry.is_directory()) {
-			auto relPath     = fs::relative(entry.path(), sourcePath);
-			auto pathToCheck = destPath / relPath;
-			if(!fs::exists(pathToCheck)) { pathsToAdd.push_back(pathToCheck); }
+	// In case the deletes don't all happen, keep the old records of them until they have, or the
+	// next run won't know they are there.
+	std::vector<fs::path> staleRecords;
+	if(incremental) {
+		for(const auto& [relPath, entry] : manifest->Entries) {
+			if(!sourceIndex.contains(relPath)) {
+				staleRecords.push_back(relPath);
+				newManifest.Entries.emplace(relPath, entry);
+			}
 		}
 	}
 
-	std::vector<ConversionJob> pathsToCopy;
-	for(const auto& entry : fs::recursive_directory_iterator(sourcePath)) {
-		if(!entry.is_directory() && isPathToCopy(entry.path())) {
-			auto relPath     = fs::relative(entry.path(), sourcePath);
-			auto pathToCheck = destPath / relPath;
-			if(!fs::exists(pathToCheck)) { pathsToCopy.emplace_back(entry.path(), pathToCheck); }
+	// Converted outputs whose source is gone, by the audio MD5 of that source. A new source with the
+	// same audio MD5 is the same file moved or renamed, so its old output can be moved to match, and
+	// retagged if the tags were edited as well.
+	std::multimap<cea::Md5Digest, const cea::ManifestEntry*> orphanedOutputs;
+	if(manifest) {
+		for(const auto& [relPath, entry] : manifest->Entries) {
+			if(entry.IsDirectory || entry.ContentId == cea::Md5Digest{} ||
+			   sourceIndex.contains(relPath)) {
+				continue;
+			}
+			// after a full rescan only trust it if the output is still there.
+			if(incremental || destIndex.contains(entry.Output)) {
+				orphanedOutputs.emplace(entry.ContentId, &entry);
+			}
 		}
 	}
+	auto findOrphan = [&](const fs::path& a_source) -> const cea::ManifestEntry* {
+		if(orphanedOutputs.empty()) { return nullptr; }
+		const auto md5 = ReadFlacMd5(a_source);
+		if(!md5) { return nullptr; }
+		auto orphan = orphanedOutputs.find(*md5);
+		if(orphan == orphanedOutputs.end()) { return nullptr; }
+		const cea::ManifestEntry* found = orphan->second;
+		orphanedOutputs.erase(orphan);
+		return found;
+	};
+	// A source that changed since its output was made, but only in its tags, can have them copied
+	// into the output instead of being converted again. The audio MD5 in the flac header says if the
+	// audio is the same as what the output was made from.
+	auto isTagOnlyChange = [&](const fs::path& a_relPath, const fs::path& a_output) {
+		if(!manifest) { return false; }
+		auto old = manifest->Entries.find(a_relPath);
+		if(old == manifest->Entries.end() || old->second.Output != a_output ||
+		   old->second.ContentId == cea::Md5Digest{}) {
+			return false;
+		}
+		const auto md5 = ReadFlacMd5(sourcePath / a_relPath);
+		return md5 && *md5 == old->second.ContentId;
+	};
 
-	// now need to add conversion work. this work must happen after the folder structure is correct
+	// Now add any missing folders, and find what needs copying, converting or moving. Those must
+	// happen after the folder structure is correct
+	auto profile = std::make_shared<const EncodeProfile>(encodeProfiles[selectedProfile]);
+	std::vector<fs::path> pathsToAdd;
+	std::vector<fs::path> recordsToAdd;
+	std::vector<ConversionJob> pathsToCopy;
 	std::vector<ConversionJob> pathsToConvert;
-	for(const auto& entry : fs::recursive_directory_iterator(sourcePath)) {
-		if(!entry.is_directory() && entry.path().extension() == ".flac") {
-			auto relPath     = fs::relative(entry.path(), sourcePath);
-			auto pathToCheck = destPath / relPath;
-			pathToCheck.replace_extension(".ogg");
-			bool needsConversion = false;
-			if(!fs::exists(pathToCheck)) {
-				needsConversion = true;
-			} else if(fs::last_write_time(entry.path()) > fs::last_write_time(pathToCheck)) {
-				needsConversion = true;
+	std::vector<MoveJob> pathsToMove;
+	std::vector<ConversionJob> pathsToRetag;
+	for(const auto& [relPath, entry] : sourceIndex) {
+		if(entry.isDirectory) {
+			if(!destIndex.contains(relPath)) {
+				pathsToAdd.push_back(destPath / relPath);
+				recordsToAdd.push_back(relPath);
+			} else {
+				newManifest.Entries.emplace(relPath, makeRecord(relPath, entry, relPath));
+			}
+		} else if(isPathToCopy(relPath)) {
+			if(!destIndex.contains(relPath)) {
+				pathsToCopy.emplace_back(sourcePath / relPath, destPath / relPath, nullptr, relPath,
+				                         makeRecord(relPath, entry, relPath), entry.size);
+			} else {
+				newManifest.Entries.emplace(relPath, makeRecord(relPath, entry, relPath));
+			}
+		} else if(HasExtension(relPath, ".flac")) {
+			auto oggPath = relPath;
+			oggPath.replace_extension(".ogg");
+			auto destEntry = destIndex.find(oggPath);
+			if(destEntry == destIndex.end() ||
+			   entry.lastWriteTime > destEntry->second.lastWriteTime) {
+				cea::ManifestEntry record = makeRecord(relPath, entry, oggPath);
+				record.Profile            = profile->name;
+				const cea::ManifestEntry* orphan =
+				    destEntry == destIndex.end() ? findOrphan(sourcePath / relPath) : nullptr;
+				if(orphan) {
+					// renames keep the file as it was, anything else about it changing means new tags.
+					const bool retag = orphan->Size != record.Size ||
+					                   orphan->LastWriteTime != record.LastWriteTime;
+					record.ContentId = orphan->ContentId;
+					record.Profile   = orphan->Profile;
+					pathsToMove.emplace_back(destPath / orphan->Output,
+					                         ConversionJob{sourcePath / relPath, destPath / oggPath, profile,
+					                                       relPath, std::move(record), entry.size},
+					                         retag);
+				} else if(destEntry != destIndex.end() && isTagOnlyChange(relPath, oggPath)) {
+					const cea::ManifestEntry& old = manifest->Entries.at(relPath);
+					record.ContentId              = old.ContentId;
+					record.Profile                = old.Profile;
+					pathsToRetag.emplace_back(sourcePath / relPath, destPath / oggPath, profile, relPath,
+					                          std::move(record), entry.size);
+				} else {
+					pathsToConvert.emplace_back(sourcePath / relPath, destPath / oggPath, profile,
+					                            relPath, std::move(record),
+					                            ConvertCost(sourcePath / relPath, entry.size));
+				}
+			} else {
+				newManifest.Entries.emplace(relPath, makeRecord(relPath, entry, oggPath));
 			}
-			if(needsConversion) { pathsToConvert.emplace_back(entry.path(), pathToCheck); }
 		}
 	}
+	// hash map order is arbitrary, keep the work in the same order as the source tree.
+	auto bySource = [](const ConversionJob& a_left, const ConversionJob& a_right) {
+		return a_left.source < a_right.source;
+	};
+	std::ranges::sort(pathsToCopy, bySource);
+	std::ranges::sort(pathsToRetag, bySource);
+	// Workers take jobs in order, so with the most expensive first the last ones to start are
+	// short, and all the workers finish at about the same time.
+	auto byCost = [](const ConversionJob& a_left, const ConversionJob& a_right) {
+		return std::tie(a_right.cost, a_left.source) < std::tie(a_left.cost, a_right.source);
+	};
+	auto byWriteTime = [](const ConversionJob& a_left, const ConversionJob& a_right) {
+		return std::tie(a_right.record.LastWriteTime, a_right.cost, a_left.source) <
+		       std::tie(a_left.record.LastWriteTime, a_left.cost, a_right.source);
+	};
+	if(newestFirst) {
+		std::ranges::sort(pathsToConvert, byWriteTime);
+	} else {
+		std::ranges::sort(pathsToConvert, byCost);
+	}
+	// moved outputs aren't deleted
+	if(!pathsToMove.empty()) {
+		std::unordered_set<fs::path, cea::PathHash> moved;
+		for(const auto& move : pathsToMove) { moved.insert(move.from); }
+		std::erase_if(filesToDelete, [&](const fs::path& a_path) { return moved.contains(a_path); });
+	}
+
+	return SyncPlan{.filesToDelete  = std::move(filesToDelete),
+	                .pathsToDelete  = std::move(pathsToDelete),
+	                .staleRecords   = std::move(staleRecords),
+	                .pathsToAdd     = std::move(pathsToAdd),
+	                .recordsToAdd   = std::move(recordsToAdd),
+	                .pathsToMove    = std::move(pathsToMove),
+	                .pathsToCopy    = std::move(pathsToCopy),
+	                .pathsToRetag   = std::move(pathsToRetag),
+	                .pathsToConvert = std::move(pathsToConvert),
+	                .manifest       = std::move(newManifest)};
+}
+
+void AddJobTime(JobTimes& a_times, uint64_t a_units,
+                std::chrono::steady_clock::time_point a_start) {
+	a_times.units += a_units;
+	a_times.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+	                           std::chrono::steady_clock::now() - a_start)
+	                           .count();
+}
 
-	// adding and removing folders are 1 job each.
-	numJobs         = (int32_t)pathsToConvert.size() + (int32_t)pathsToCopy.size() + 3;
+// Queues everything in a_plan for the workers.
+void QueueSync(SyncPlan a_plan) {
+	// adding and removing folders are 1 job each. Moves that need retagging are counted here, they
+	// become a retag or a convert later.
+	const auto movesToRetag = std::ranges::count_if(a_plan.pathsToMove, &MoveJob::retag);
+	numJobs = (int32_t)(a_plan.pathsToConvert.size() + a_plan.pathsToCopy.size() +
+	                    a_plan.pathsToRetag.size() + movesToRetag) +
+	          3;
 	completedJobs   = 0;
 	convertProgress = 0.0f;
 
-	// and push a work item to make these changes.
+	for(JobTimes* times : {&convertTimes, &copyTimes, &retagTimes, &fileOpTimes}) {
+		times->units       = 0;
+		times->nanoseconds = 0;
+	}
+
 	{
-		std::scoped_lock loc(dataMutex);
-		workQueue.emplace_back([filesToDelete = std::move(filesToDelete)]() {
-			for(const auto& path : filesToDelete) {
-				SetOperation("removing path {}", path.string());
-				if(fs::exists(path)) { fs::remove(path); }
-			}
-			FinishedJob();
-		});
-		workQueue.emplace_back([pathsToDelete = std::move(pathsToDelete)]() {
-			for(const auto& path : pathsToDelete) {
-				SetOperation("removing path {}", path.string());
-				// may have already been deleted if its a sub folder
-				if(fs::exists(path)) { fs::remove_all(path); }
+		std::scoped_lock lock(manifestMutex);
+		pendingManifest = std::move(a_plan.manifest);
+		manifestPending = true;
+	}
+	journal.emplace(c_journalPath, sourcePath, destPath);
+	if(!journal->isValid()) {
+		AddError("Failed to create {}, an interrupted run will start over", c_journalPath.string());
+		journal.reset();
+	}
+
+	// Folder structure has to be correct before any copy or conversion can run, so the first work
+	// item does all the deletes, adds and moves, and only then fans out one work item per file so
+	// every worker can pick them up. Moves go after the adds so their new folder is there, and before
+	// the folder deletes since an old output is often in a folder that is going away.
+	QueueWork([plan = std::move(a_plan), depth = prefetchDepth, evict = evictSources]() mutable {
+		auto& [filesToDelete, pathsToDelete, staleRecords, pathsToAdd, recordsToAdd, pathsToMove,
+		       pathsToCopy, pathsToRetag, pathsToConvert, manifest] = plan;
+		const auto start = std::chrono::steady_clock::now();
+		for(const auto& path : filesToDelete) {
+			SetOperation("removing path {}", path.string());
+			if(fs::exists(path)) { fs::remove(path); }
+		}
+		FinishedJob();
+		for(const auto& path : pathsToAdd) {
+			SetOperation("Adding path {}", path.string());
+			// may have already been added if a sub folder was already added
+			if(!fs::exists(path)) { fs::create_directories(path); }
+		}
+		for(const auto& relPath : recordsToAdd) {
+			cea::ManifestEntry record;
+			record.IsDirectory = true;
+			record.Output      = relPath;
+			RecordOutput(relPath, std::move(record));
+		}
+		FinishedJob();
+		for(auto& move : pathsToMove) {
+			SetOperation("Moving {} to {}", move.from.string(), move.convert.dest.string());
+			std::error_code ec;
+			fs::rename(move.from, move.convert.dest, ec);
+			if(ec) {
+				AddError("Failed to move {}, converting it instead. error {}", move.from.string(),
+				         ec.message());
+				if(!move.retag) { ++numJobs; }
+				pathsToConvert.push_back(std::move(move.convert));
+			} else if(move.retag) {
+				pathsToRetag.push_back(std::move(move.convert));
+			} else {
+				RecordOutput(move.convert.relPath, move.convert.record);
 			}
-			FinishedJob();
-		});
-		workQueue.emplace_back([pathsToAdd = std::move(pathsToAdd)]() {
-			for(const auto& path : pathsToAdd) {
-				SetOperation("Adding path {}", path.string());
-				// may have already been added if a sub folder was already added
-				if(!fs::exists(path)) { fs::create_directories(path); }
+		}
+		for(const auto& path : pathsToDelete) {
+			SetOperation("removing path {}", path.string());
+			// may have already been deleted if its a sub folder
+			if(fs::exists(path)) { fs::remove_all(path); }
+		}
+		{
+			std::scoped_lock lock(manifestMutex);
+			for(const auto& relPath : staleRecords) {
+				pendingManifest.Entries.erase(relPath);
+				if(journal) { journal->Remove(relPath); }
 			}
-			FinishedJob();
-		});
-		workQueue.emplace_back([pathsToCopy = std::move(pathsToCopy)]() {
-			for(const auto& job : pathsToCopy) {
+		}
+		AddJobTime(fileOpTimes,
+		           filesToDelete.size() + pathsToAdd.size() + pathsToMove.size() +
+		               pathsToDelete.size(),
+		           start);
+		FinishedJob();
+
+		if(CancelWork.load()) { return; }
+
+		for(auto& job : pathsToCopy) {
+			QueueWork([job = std::move(job), evict]() {
 				SetOperation("Copying from {} to {}", job.source.string(), job.dest.string());
-				fs::copy_file(job.source, job.dest, fs::copy_options::overwrite_existing);
+				const auto start = std::chrono::steady_clock::now();
+				// copied under a temp name and renamed, same as converted files, so an interrupted
+				// copy never looks like a finished one.
+				JournalBegin(job, false);
+				const fs::path tempPath = fs::path(job.dest) += ".partial";
+				std::error_code ec;
+				if(cep::CloneOrCopyFile(job.source, tempPath, ec)) { fs::rename(tempPath, job.dest, ec); }
+				if(ec) {
+					AddError("Failed to copy {}. error {}", job.source.string(), ec.message());
+					fs::remove(tempPath, ec);
+				} else {
+					AddJobTime(copyTimes, job.cost, start);
+					RecordOutput(job.relPath, job.record);
+				}
+				if(evict) { cep::EvictFile(job.source); }
 				FinishedJob();
-			}
-		});
-		workQueue.emplace_back([pathsToConvert = std::move(pathsToConvert)]() {
-			for(const auto& job : pathsToConvert) {
-				// keep computer from going to sleep.
-				SetThreadExecutionState(ES_SYSTEM_REQUIRED);
+			});
+		}
+		for(auto& job : pathsToRetag) {
+			QueueWork([job = std::move(job), evict]() {
+				SetOperation("Updating tags of {} from {}", job.dest.string(), job.source.string());
+				const auto start    = std::chrono::steady_clock::now();
+				auto contentId      = RetagFile(job);
+				const bool retagged = contentId.has_value();
+				if(retagged) { AddJobTime(retagTimes, 1, start); }
+				if(!retagged && !CancelWork.load()) {
+					KeepSystemAwake();
+					SetOperation("Converting from {} to {}", job.source.string(), job.dest.string());
+					JournalBegin(job, false);
+					contentId = ConvertFile(job);
+				}
+				if(contentId) {
+					cea::ManifestEntry record = job.record;
+					record.ContentId          = *contentId;
+					if(!retagged) { record.Profile = job.profile->name; }
+					RecordOutput(job.relPath, std::move(record));
+				}
+				if(evict) { cep::EvictFile(job.source); }
+				FinishedJob();
+			});
+		}
+		// the first few are read in while the copies and retags run, after that each conversion as it
+		// starts reads in the one depth places after it in the queue. Retags only read the tags, they
+		// aren't worth it.
+		auto upcoming = std::make_shared<std::vector<fs::path>>();
+		for(const auto& job : pathsToConvert) { upcoming->push_back(job.source); }
+		for(size_t i = 0; i < std::min<size_t>(depth, upcoming->size()); ++i) {
+			cep::PrefetchFile((*upcoming)[i]);
+		}
+		for(size_t i = 0; i < pathsToConvert.size(); ++i) {
+			QueueWork([job = std::move(pathsToConvert[i]), upcoming, depth, evict,
+			           next = i + depth]() {
+				if(depth > 0 && next < upcoming->size()) { cep::PrefetchFile((*upcoming)[next]); }
+				KeepSystemAwake();
 				SetOperation("Converting from {} to {}", job.source.string(), job.dest.string());
-				ConvertFile(job);
+				const auto start = std::chrono::steady_clock::now();
+				JournalBegin(job, false);
+				if(auto contentId = ConvertFile(job)) {
+					// long tracks are split across workers, so those look faster per worker than they
+					// were. Close enough for an estimate.
+					AddJobTime(convertTimes, job.cost, start);
+					// a failed move can end up here still carrying the profile of the old output.
+					cea::ManifestEntry record = job.record;
+					record.ContentId          = *contentId;
+					record.Profile            = job.profile->name;
+					RecordOutput(job.relPath, std::move(record));
+				}
+				// ConvertFile has unmapped it by now, mapped pages can't be dropped.
+				if(evict) { cep::EvictFile(job.source); }
 				FinishedJob();
-			}
-		});
+			});
+		}
+	});
+}
+
+// Empty if the roots aren't usable.
+std::optional<SyncPlan> PlanCurrentSync() {
+	if(!PrepareRoots()) { return std::nullopt; }
+
+	// Normally the manifest from the last run stands in for the destination, so only the source is
+	// walked. Without one that matches these roots, or if asked to, walk the destination as well.
+	// Source and dest are often on different drives, so walk both at once.
+	std::optional<cea::SyncManifest> manifest = LoadCurrentManifest();
+	const bool incremental                    = manifest && !fullRescan;
+	std::future<std::optional<TreeIndex>> destIndexFuture;
+	if(!incremental) {
+		destIndexFuture = std::async(std::launch::async, IndexTree, std::cref(destPath));
+	}
+	const std::optional<TreeIndex> sourceIndex = IndexTree(sourcePath);
+	const std::optional<TreeIndex> destIndex =
+	    incremental ? IndexFromManifest(*manifest) : destIndexFuture.get();
+	// half a tree would look like the rest was deleted.
+	if(!sourceIndex || !destIndex) { return std::nullopt; }
+
+	return PlanSync(*sourceIndex, *destIndex, manifest, incremental);
+}
+
+void StartConversion() {
+	ClearErrorLog();
+	CancelWork.store(false);
+	dryRunReport.clear();
+	if(!PrepareRoots()) { return; }
+	FinishInterruptedRun();
+	if(auto plan = PlanCurrentSync()) { QueueSync(std::move(*plan)); }
+}
+
+// Syncs only a_changed, paths relative to the source, from the watcher. Everything else in the
+// source is taken to be as the manifest has it, so neither tree is walked. Without a manifest
+// for these roots there is nothing to go on, and it falls back to a full StartConversion.
+void StartWatchSync(const ChangedPaths& a_changed) {
+	CancelWork.store(false);
+	if(!PrepareRoots()) { return; }
+	FinishInterruptedRun();
+
+	std::optional<cea::SyncManifest> manifest = LoadCurrentManifest();
+	if(!manifest) {
+		StartConversion();
+		return;
+	}
+	const TreeIndex sourceIndex = IndexChangedSource(*manifest, a_changed);
+	const TreeIndex destIndex   = IndexFromManifest(*manifest);
+
+	QueueSync(PlanSync(sourceIndex, destIndex, manifest, true));
+}
+
+uint32_t WorkerCount() {
+	if(workerThreadCount != 0) { return workerThreadCount; }
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+double ConvertThroughput(const std::string& a_profileName) {
+	auto measured = throughput.convert.find(a_profileName);
+	return measured != throughput.convert.end() ? measured->second : c_defaultConvertThroughput;
+}
+
+// Only run once nothing from the run is still going.
+void UpdateThroughput() {
+	// anything shorter is mostly noise.
+	constexpr int64_t c_minNanoseconds = 1'000'000'000;
+
+	auto update = [](double& a_value, JobTimes& a_times) {
+		if(a_times.nanoseconds.load() >= c_minNanoseconds) {
+			const double measured = a_times.units.load() * 1e9 / a_times.nanoseconds.load();
+			// average in the new measurement so one odd run doesn't throw it off.
+			a_value = a_value > 0.0 ? (a_value + measured) / 2.0 : measured;
+		}
+		a_times.units       = 0;
+		a_times.nanoseconds = 0;
+	};
+	update(throughput.convert[encodeProfiles[selectedProfile].name], convertTimes);
+	update(throughput.copy, copyTimes);
+	update(throughput.retag, retagTimes);
+	update(throughput.fileOps, fileOpTimes);
+}
+
+std::string FormatDuration(double a_seconds) {
+	const auto total = (int64_t)std::ceil(a_seconds);
+	return fmt::format("{}:{:02}:{:02}", total / 3600, total / 60 % 60, total % 60);
+}
+
+// Summary of what a_plan will do and how long it should take with a_numWorkers. Everything but
+// the first phase is spread over all the workers. With a_listPaths every path is listed as well.
+std::string DescribePlan(const SyncPlan& a_plan, uint32_t a_numWorkers, bool a_listPaths) {
+	auto measuredOr = [](double a_value, double a_default) {
+		return a_value > 0.0 ? a_value : a_default;
+	};
+	auto totalCost = [](const std::vector<ConversionJob>& a_jobs) {
+		uint64_t total = 0;
+		for(const auto& job : a_jobs) { total += job.cost; }
+		return total;
+	};
+	const auto movesToRetag = (size_t)std::ranges::count_if(a_plan.pathsToMove, &MoveJob::retag);
+	const size_t numFileOps = a_plan.filesToDelete.size() + a_plan.pathsToAdd.size() +
+	                          a_plan.pathsToMove.size() + a_plan.pathsToDelete.size();
+	const size_t numRetags  = a_plan.pathsToRetag.size() + movesToRetag;
+	const uint64_t copyBytes = totalCost(a_plan.pathsToCopy);
+
+	const double fileOpSeconds =
+	    numFileOps / measuredOr(throughput.fileOps, c_defaultFileOpThroughput);
+	const double copySeconds =
+	    copyBytes / measuredOr(throughput.copy, c_defaultCopyThroughput) / a_numWorkers;
+	const double retagSeconds =
+	    numRetags / measuredOr(throughput.retag, c_defaultRetagThroughput) / a_numWorkers;
+	const double convertSeconds =
+	    totalCost(a_plan.pathsToConvert) /
+	    ConvertThroughput(encodeProfiles[selectedProfile].name) / a_numWorkers;
+
+	std::string report = fmt::format(
+	    "Sync {} to {} with profile {} on {} workers\n"
+	    "Deletes, adds and moves: {} files, {} folders deleted, {} folders added, {} moved, {}\n"
+	    "Copies: {} files, {:.1f} MB, {}\n"
+	    "Tag updates: {} files, {}\n"
+	    "Conversions: {} files, {}\n"
+	    "Total: {}\n",
+	    sourcePath.string(), destPath.string(), encodeProfiles[selectedProfile].name, a_numWorkers,
+	    a_plan.filesToDelete.size(), a_plan.pathsToDelete.size(), a_plan.pathsToAdd.size(),
+	    a_plan.pathsToMove.size(), FormatDuration(fileOpSeconds), a_plan.pathsToCopy.size(),
+	    copyBytes / (1024.0 * 1024.0), FormatDuration(copySeconds), numRetags,
+	    FormatDuration(retagSeconds), a_plan.pathsToConvert.size(), FormatDuration(convertSeconds),
+	    FormatDuration(fileOpSeconds + copySeconds + retagSeconds + convertSeconds));
+	if(!a_listPaths) { return report; }
+
+	report += "\n";
+	for(const auto& path : a_plan.filesToDelete) {
+		report += fmt::format("delete {}\n", path.string());
+	}
+	for(const auto& path : a_plan.pathsToAdd) { report += fmt::format("add {}\n", path.string()); }
+	for(const auto& move : a_plan.pathsToMove) {
+		report += fmt::format("move {} to {}{}\n", move.from.string(), move.convert.dest.string(),
+		                      move.retag ? ", update tags" : "");
+	}
+	for(const auto& path : a_plan.pathsToDelete) {
+		report += fmt::format("delete folder {}\n", path.string());
+	}
+	for(const auto& job : a_plan.pathsToCopy) {
+		report += fmt::format("copy {} to {}\n", job.source.string(), job.dest.string());
+	}
+	for(const auto& job : a_plan.pathsToRetag) {
+		report += fmt::format("update tags of {} from {}\n", job.dest.string(), job.source.string());
+	}
+	for(const auto& job : a_plan.pathsToConvert) {
+		report += fmt::format("convert {} to {}\n", job.source.string(), job.dest.string());
 	}
+	return report;
+}
+
+// Plans a sync without doing any of it. The summary is shown in the ui, the full plan goes in
+// c_dryRunPath.
+void StartDryRun() {
+	ClearErrorLog();
+	auto plan = PlanCurrentSync();
+	if(!plan) {
+		dryRunReport.clear();
+		return;
+	}
+	dryRunReport = DescribePlan(*plan, (uint32_t)workerThreads.size(), false);
+
+	std::ofstream outputFile(c_dryRunPath);
+	outputFile << DescribePlan(*plan, (uint32_t)workerThreads.size(), true);
+	if(!outputFile) { AddError("Failed to write {}", c_dryRunPath.string()); }
 }
 
 void CancelConversion() {
@@ -600,21 +2429,23 @@ void CancelConversion() {
 void WorkerMain(std::stop_token stoken) {
 	std::move_only_function<void()> workItem;
 	while(!stoken.stop_requested()) {
-		if(CancelWork.load() == true) {
-			std::scoped_lock loc(dataMutex);
-			workQueue.clear();
-			WorkCancelled.store(true);
-		}
 		{
 			std::scoped_lock loc(dataMutex);
-			if(!workQueue.empty()) {
+			if(CancelWork.load() == true) {
+				workQueue.clear();
+				// Not cancelled until every worker has returned from the item it was running.
+				if(activeWorkers == 0) { WorkCancelled.store(true); }
+			} else if(!workQueue.empty()) {
 				workItem = std::move(workQueue.front());
 				workQueue.pop_front();
+				++activeWorkers;
 			}
 		}
 		if(workItem) {
 			workItem();
 			workItem = nullptr;
+			std::scoped_lock loc(dataMutex);
+			--activeWorkers;
 		} else {
 			std::this_thread::sleep_for(50ms);
 		}
@@ -626,31 +2457,47 @@ void CleanUpPathNames(const fs::path& pathToClean) {
 		fs::path from;
 		fs::path to;
 	};
+	const uint32_t numThreads = WalkThreadCount();
+	std::vector<std::vector<RenameOp>> threadFiles(numThreads);
+	std::vector<std::vector<RenameOp>> threadFolders(numThreads);
+	auto walkError = cea::WalkDirectory(
+	    pathToClean, numThreads,
+	    [&](uint32_t a_thread, const fs::directory_entry& a_entry, const fs::path&) {
+		    std::error_code ec;
+		    const bool isDirectory = a_entry.is_directory(ec);
+		    if(!isDirectory && !a_entry.is_regular_file(ec)) { return; }
+		    // only the name, any parent folders that need fixing get their own op.
+		    auto fixedName = a_entry.path().filename().u16string();
+		    bool hadToFix  = false;
+		    std::erase_if(fixedName, [&](char16_t input) {
+			    if(input < 32 || input > 126) {
+				    hadToFix = true;
+				    return true;
+			    } else {
+				    return false;
+			    }
+		    });
+		    // fs::equivalent crashes on windows with unicode
+		    if(hadToFix) {
+			    auto& ops = isDirectory ? threadFolders[a_thread] : threadFiles[a_thread];
+			    ops.emplace_back(a_entry.path(), a_entry.path().parent_path() / fixedName);
+		    }
+	    });
+	// whatever was found still gets fixed, nothing is deleted here.
+	if(walkError) {
+		AddError("Failed to list {}. error {}", walkError->Path.string(), walkError->Error.message());
+	}
+
 	std::vector<RenameOp> filesToRename;
 	std::vector<RenameOp> foldersToRename;
-	for(const auto& entry : fs::recursive_directory_iterator(pathToClean)) {
-		if(entry.is_directory() || entry.is_regular_file()) {
-			auto fixedPathString = entry.path().u16string();
-			bool hadToFix        = false;
-			std::erase_if(fixedPathString, [&](char16_t input) {
-				if(input < 32 || input > 126) {
-					hadToFix = true;
-					return true;
-				} else {
-					return false;
-				}
-			});
-			fs::path fixedPath = fixedPathString;
-			// fs::equivalent crashes on windows with unicode
-			if(hadToFix) {
-				if(entry.is_directory()) {
-					foldersToRename.emplace_back(entry.path(), fixedPath);
-				} else {
-					filesToRename.emplace_back(entry.path(), fixedPath);
-				}
-			}
-		}
+	for(uint32_t i = 0; i < numThreads; ++i) {
+		std::ranges::move(threadFiles[i], std::back_inserter(filesToRename));
+		std::ranges::move(threadFolders[i], std::back_inserter(foldersToRename));
 	}
+	// Files first while their folders still have the old names, then folders deepest first so a
+	// folder is never renamed out from under one of its children.
+	std::ranges::sort(foldersToRename, std::greater{},
+	                  [](const RenameOp& a_op) { return std::ranges::distance(a_op.from); });
 	for(const auto& op : filesToRename) {
 		SetOperation("rename {}", op.to.string().c_str());
 		std::error_code ec;
@@ -665,6 +2512,52 @@ void CleanUpPathNames(const fs::path& pathToClean) {
 	}
 }
 
+// Called every frame. Collects what the watcher saw, and starts a sync of just those paths once
+// the source has settled and nothing else is running.
+void UpdateWatch() {
+	if(!watchSource) {
+		sourceWatcher.reset();
+		watchChanges.clear();
+		watchMissedEvents = false;
+		return;
+	}
+	if(!sourceWatcher) {
+		sourceWatcher.emplace(fs::path(sourcePathString));
+		if(!sourceWatcher->isValid()) {
+			AddError("Could not watch {}", sourcePathString);
+			sourceWatcher.reset();
+			watchSource = false;
+			return;
+		}
+		// anything could have changed while nobody was watching.
+		watchMissedEvents = true;
+		lastWatchEvent    = std::chrono::steady_clock::now();
+	}
+
+	std::vector<fs::path> changed;
+	if(!sourceWatcher->Poll(changed)) { watchMissedEvents = true; }
+	if(!changed.empty()) {
+		watchChanges.insert(std::make_move_iterator(changed.begin()),
+		                    std::make_move_iterator(changed.end()));
+		lastWatchEvent = std::chrono::steady_clock::now();
+	}
+
+	if(appState != AppState::Idle || (watchChanges.empty() && !watchMissedEvents) ||
+	   std::chrono::steady_clock::now() - lastWatchEvent < c_watchSettleTime) {
+		return;
+	}
+	appState = AppState::Converting;
+	if(watchMissedEvents) {
+		SetOperation("Source changed, syncing everything");
+		StartConversion();
+	} else {
+		SetOperation("Source changed, syncing {} paths", watchChanges.size());
+		StartWatchSync(watchChanges);
+	}
+	watchChanges.clear();
+	watchMissedEvents = false;
+}
+
 void DrawUI() {
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
 	glfwSetWindowTitle(window, "Music Converter");
@@ -683,6 +2576,8 @@ void DrawUI() {
 			glfwSetWindowAttrib(window, GLFW_DECORATED, true);
 		}
 
+		// the watcher is for the path as it was when watching started.
+		ImGui::BeginDisabled(watchSource);
 		ImGui::SetNextItemWidth(1000);
 		ImGui::InputText("Source Path", &sourcePathString, ImGuiInputTextFlags_CharsNoBlank);
 		if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
@@ -692,6 +2587,25 @@ void DrawUI() {
 		ImGui::InputText("Destination Path", &destPathString, ImGuiInputTextFlags_CharsNoBlank);
 		if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
 			ImGui::SetTooltip("Path were mp3 files will be saved");
+		ImGui::EndDisabled();
+
+		ImGui::Checkbox("Watch Source", &watchSource);
+		if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+			ImGui::SetTooltip("Sync changes to the source path as they happen");
+
+		ImGui::BeginDisabled(appState != AppState::Idle);
+		ImGui::SetNextItemWidth(1000);
+		if(ImGui::BeginCombo("Encode Profile", encodeProfiles[selectedProfile].name.c_str())) {
+			for(uint32_t i = 0; i < encodeProfiles.size(); ++i) {
+				if(ImGui::Selectable(encodeProfiles[i].name.c_str(), i == selectedProfile)) {
+					selectedProfile = i;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		ImGui::EndDisabled();
+		if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal | ImGuiHoveredFlags_AllowWhenDisabled))
+			ImGui::SetTooltip("Encoder and resampler settings, from encode_profiles in config.json");
 
 		ImGui::SeparatorEx(ImGuiSeparatorFlags_Horizontal);
 
@@ -703,10 +2617,34 @@ void DrawUI() {
 					SetOperation("Starting Conversion");
 					StartConversion();
 				}
+				ImGui::SameLine();
+				if(ImGui::Button("Dry Run", {0, 0})) {
+					SetOperation("Planning");
+					StartDryRun();
+				}
+				if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+					ImGui::SetTooltip("Show what converting would do and how long it should take, "
+					                  "without changing anything. Full plan is written to %s",
+					                  c_dryRunPath.string().c_str());
+				ImGui::SameLine();
+				ImGui::Checkbox("Full Rescan", &fullRescan);
+				if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+					ImGui::SetTooltip("Walk the destination instead of trusting %s, use if something else "
+					                  "changed it",
+					                  c_manifestPath.string().c_str());
+				ImGui::SameLine();
+				ImGui::Checkbox("Newest First", &newestFirst);
+				if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+					ImGui::SetTooltip("Convert the most recently changed files first, instead of the "
+					                  "longest first. Takes longer overall");
 				if(ImGui::Button("Clean up source path names", {0, 0})) {
 					SetOperation("Clean up source path names");
 					CleanUpPathNames(sourcePath);
 					CleanUpPathNames(destPath);
+					// renamed files won't match what it recorded.
+					std::error_code ec;
+					fs::remove(c_manifestPath, ec);
+					fs::remove(c_journalPath, ec);
 				}
 
 			} else if(appState == AppState::Converting) {
@@ -715,8 +2653,9 @@ void DrawUI() {
 					SetOperation("Canceling Conversion");
 					CancelConversion();
 				} else {
-					std::scoped_lock loc(dataMutex);
-					if(completedJobs == numJobs) {
+					if(completedJobs.load() == numJobs.load()) {
+						SavePendingManifest();
+						UpdateThroughput();
 						numJobs         = 0;
 						completedJobs   = 0;
 						convertProgress = 0.0f;
@@ -729,6 +2668,8 @@ void DrawUI() {
 				ImGui::EndDisabled();
 
 				if(WorkCancelled.load()) {
+					SavePendingManifest();
+					UpdateThroughput();
 					numJobs         = 0;
 					completedJobs   = 0;
 					convertProgress = 0.0f;
@@ -738,18 +2679,25 @@ void DrawUI() {
 
 			ImGui::SameLine();
 
-			std::string progressText = fmt::format("Job: {}/{}", completedJobs, numJobs);
+			std::string progressText = fmt::format("Job: {}/{}", completedJobs.load(), numJobs.load());
 			ImGui::InputText("##progress_text", &progressText, ImGuiInputTextFlags_ReadOnly);
 
 			ImGui::SeparatorEx(ImGuiSeparatorFlags_Horizontal);
 
-			ImGui::ProgressBar(convertProgress, {1260, 0}, nullptr);
+			ImGui::ProgressBar(convertProgress.load(), {1260, 0}, nullptr);
 
 			ImGui::AlignTextToFramePadding();
 			std::string operation = GetOperation();
 			ImGui::InputText("Current Operation", &operation, ImGuiInputTextFlags_ReadOnly);
+			float logHeight = 510;
+			if(!dryRunReport.empty()) {
+				constexpr float c_reportHeight = 200;
+				ImGui::InputTextMultiline("##dry_run_text", &dryRunReport, ImVec2(1260, c_reportHeight),
+				                          ImGuiInputTextFlags_ReadOnly);
+				logHeight -= c_reportHeight + ImGui::GetStyle().ItemSpacing.y;
+			}
 			std::string log = GetErrorLog();
-			ImGui::InputTextMultiline("##log_text", &log, ImVec2(1260, 510),
+			ImGui::InputTextMultiline("##log_text", &log, ImVec2(1260, logHeight),
 			                          ImGuiInputTextFlags_ReadOnly |
 			                              ImGuiInputTextFlags_NoHorizontalScroll);
 		}
@@ -759,11 +2707,418 @@ void DrawUI() {
 	ImGui::PopStyleVar();
 }
 
-int main(int, char**) {
+// Times decode through PcmStream for one file, on its own and followed by an opus encode, once
+// for the float path and once for the 16 bit path if the file can use it, and adds a row for it to
+// a_pathRows. Single threaded, no file output, so it only measures the cpu side of a conversion.
+//
+// Files that need a resample also get a row in a_resamplerRows for every resampler engine, the
+// libsamplerate ones and speex at a few qualities. Speed is decode plus resample, quality is how
+// far the first 30 seconds are from sinc_best, as signal to difference in dB. Higher is closer,
+// anything past about 100dB is below what the encoder keeps anyway.
+bool BenchmarkPcmFile(const fs::path& a_file, std::string& a_pathRows,
+                      std::string& a_resamplerRows) {
+	if(!fs::exists(a_file)) {
+		fmt::print("{} doesn't exist\n", a_file.string());
+		return false;
+	}
+	cep::MemoryMappedFile sourceFile(a_file);
+	if(!sourceFile.isValid()) {
+		fmt::print("{} could not be read, or is empty\n", a_file.string());
+		return false;
+	}
+	MappedFlacStream flacStream{&sourceFile};
+	drflac* drFlac = OpenFlac(flacStream);
+	if(drFlac == nullptr) {
+		fmt::print("{} could not be opened as a flac file\n", a_file.string());
+		return false;
+	}
+	auto closeFlac = cecore::defer([&] { drflac_close(drFlac); });
+
+	FlacInfo flacInfo{};
+	flacInfo.numFrames     = drFlac->totalPCMFrameCount;
+	flacInfo.sampleRate    = drFlac->sampleRate;
+	flacInfo.numChannels   = drFlac->channels;
+	flacInfo.bitsPerSample = drFlac->bitsPerSample;
+	if(flacInfo.numFrames == 0 || cea::GetDownmixMatrix(flacInfo.numChannels) == nullptr) {
+		fmt::print("{} is not a supported flac file\n", a_file.string());
+		return false;
+	}
+	const double trackSeconds = (double)flacInfo.numFrames / flacInfo.sampleRate;
+	fmt::print("{}: {} bit, {}Hz, {} channels, {:.1f}s\n", a_file.string(),
+	           flacInfo.bitsPerSample, flacInfo.sampleRate, flacInfo.numChannels, trackSeconds);
+
+	// config isn't loaded, so this is the built in archive profile.
+	const EncodeProfile& profile = encodeProfiles[selectedProfile];
+
+	// returns how long the pass took in seconds
+	auto runPass = [&]<typename SampleT>(bool a_encode, const ResamplerConfig& a_resampler) {
+		drflac_seek_to_pcm_frame(drFlac, 0);
+		PcmStream pcm(drFlac, flacInfo, flacInfo.numFrames, a_resampler);
+
+		int error{};
+		OpusEncoder* encoder = opus_encoder_create(c_targetSampleRate, c_numOutputChannels,
+		                                           OPUS_APPLICATION_AUDIO, &error);
+		if(encoder == nullptr) { return 0.0; }
+		auto destroyEncoder = cecore::defer([&] { opus_encoder_destroy(encoder); });
+		ConfigureOpusEncoder(encoder, profile);
+
+		std::array<SampleT, c_opusFrameSize * c_numOutputChannels> frame{};
+		std::array<unsigned char, c_maxOpusPacketSize> packet;
+
+		cecore::Timer timer;
+		while(pcm.Read(frame.data(), c_opusFrameSize) == c_opusFrameSize) {
+			if(!a_encode) { continue; }
+			if constexpr(std::is_same_v<SampleT, int16_t>) {
+				opus_encode(encoder, frame.data(), c_opusFrameSize, packet.data(),
+				            (opus_int32)packet.size());
+			} else {
+				opus_encode_float(encoder, frame.data(), c_opusFrameSize, packet.data(),
+				                  (opus_int32)packet.size());
+			}
+		}
+		timer.Update();
+		return timer.GetTotalTime();
+	};
+	auto speed = [&](double a_seconds) { return fmt::format("{:.1f}x", trackSeconds / a_seconds); };
+
+	const std::string format = fmt::format("{} bit {}Hz {}ch", flacInfo.bitsPerSample,
+	                                       flacInfo.sampleRate, flacInfo.numChannels);
+	const double floatDecode = runPass.operator()<float>(false, profile.resampler);
+	const double floatEncode = runPass.operator()<float>(true, profile.resampler);
+	if(PcmStream(drFlac, flacInfo, 0, profile.resampler).SupportsInteger()) {
+		const double intDecode = runPass.operator()<int16_t>(false, profile.resampler);
+		const double intEncode = runPass.operator()<int16_t>(true, profile.resampler);
+		a_pathRows += fmt::format("| {} | {} | {} | {} | {} | {} |\n", a_file.filename().string(),
+		                          format, speed(floatDecode), speed(intDecode), speed(floatEncode),
+		                          speed(intEncode));
+	} else {
+		// 16 bit path is only for 16 bit 48kHz sources.
+		a_pathRows += fmt::format("| {} | {} | {} | - | {} | - |\n", a_file.filename().string(),
+		                          format, speed(floatDecode), speed(floatEncode));
+	}
+	if(flacInfo.sampleRate == c_targetSampleRate) { return true; }
+
+	auto capture = [&](const ResamplerConfig& a_resampler) {
+		drflac_seek_to_pcm_frame(drFlac, 0);
+		const uint64_t numFrames = std::min<uint64_t>(flacInfo.numFrames, 30 * flacInfo.sampleRate);
+		PcmStream pcm(drFlac, flacInfo, numFrames, a_resampler);
+		std::vector<float> output;
+		std::array<float, c_blockFrames * c_numOutputChannels> block;
+		while(uint32_t frames = pcm.Read(block.data(), c_blockFrames)) {
+			output.insert(output.end(), block.data(), block.data() + frames * c_numOutputChannels);
+		}
+		return output;
+	};
+
+	std::vector<std::pair<std::string, ResamplerConfig>> engines;
+	for(uint32_t engine = 0; engine < c_resamplerEngineNames.size(); ++engine) {
+		if((ResamplerEngine)engine == ResamplerEngine::Speex) { continue; }
+		engines.emplace_back(c_resamplerEngineNames[engine],
+		                     ResamplerConfig{(ResamplerEngine)engine});
+	}
+	for(int32_t quality : {3, 5, 7, 10}) {
+		engines.emplace_back(fmt::format("speex q{}", quality),
+		                     ResamplerConfig{ResamplerEngine::Speex, quality});
+	}
+
+	const std::vector<float> reference = capture({ResamplerEngine::SincBest});
+	for(const auto& [name, config] : engines) {
+		const double seconds = runPass.operator()<float>(false, config);
+
+		const std::vector<float> output = capture(config);
+		double signal{};
+		double difference{};
+		for(size_t i = 0; i < std::min(reference.size(), output.size()); ++i) {
+			signal += (double)reference[i] * reference[i];
+			difference += ((double)reference[i] - output[i]) * (reference[i] - output[i]);
+		}
+		const std::string quality = difference == 0.0 ?
+		                                std::string("reference") :
+		                                fmt::format("{:.1f}dB", 10.0 * std::log10(signal / difference));
+		a_resamplerRows += fmt::format("| {} | {}Hz | {} | {} | {} |\n", a_file.filename().string(),
+		                               flacInfo.sampleRate, name, speed(seconds), quality);
+	}
+	return true;
+}
+
+// Benchmarks every file in a_files, see BenchmarkPcmFile. The float and 16 bit timings, and the
+// resamplers for files that need one, are printed at the end as markdown tables with a row per
+// file or per file and engine. Speeds are in x realtime.
+int RunPcmBenchmark(const std::vector<fs::path>& a_files) {
+	std::string pathRows;
+	std::string resamplerRows;
+	bool failed = false;
+	for(const fs::path& file : a_files) {
+		if(!BenchmarkPcmFile(file, pathRows, resamplerRows)) { failed = true; }
+	}
+	fmt::print("\n| file | format | float decode | int16 decode | float encode | int16 encode |\n");
+	fmt::print("|---|---|---:|---:|---:|---:|\n{}", pathRows);
+	if(!resamplerRows.empty()) {
+		fmt::print("\n| file | rate | resampler | speed | vs sinc_best |\n");
+		fmt::print("|---|---|---|---:|---:|\n{}", resamplerRows);
+	}
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// An ogg opus file decoded back to 48k stereo.
+struct DecodedOpus {
+	int32_t preskip{};
+	// of the last page, preskip included.
+	uint64_t finalGranule{};
+	// false if a granule went backwards, or the stream didn't end on an end of stream page.
+	bool granulesValid{true};
+	// interleaved, with the preskip dropped and cut off at the final granule.
+	std::vector<float> pcm;
+};
+
+std::optional<DecodedOpus> DecodeOggOpus(const fs::path& a_path) {
+	cep::MemoryMappedFile file(a_path);
+	if(!file.isValid()) { return std::nullopt; }
+	const std::span<const std::byte> data = file.GetData();
+
+	int error{};
+	OpusDecoder* decoder = opus_decoder_create(c_targetSampleRate, c_numOutputChannels, &error);
+	if(decoder == nullptr) { return std::nullopt; }
+	auto destroyDecoder = cecore::defer([&] { opus_decoder_destroy(decoder); });
+
+	DecodedOpus result;
+	// 120ms, the longest a packet can be.
+	constexpr int32_t c_maxPacketFrames = 5760;
+	std::array<float, c_maxPacketFrames * c_numOutputChannels> frame;
+	std::vector<unsigned char> packet;
+	uint32_t packetNumber = 0;
+	bool endOfStream      = false;
+	OggPage page;
+	for(size_t offset = 0; ReadOggPage(data, offset, page);
+	    offset += page.headerSize + page.bodySize) {
+		uint64_t granule{};
+		std::memcpy(&granule, data.data() + offset + c_oggGranuleOffset, sizeof(granule));
+		if(granule != c_oggNoGranule) {
+			if(granule < result.finalGranule) { result.granulesValid = false; }
+			result.finalGranule = granule;
+		}
+		endOfStream = (page.flags & c_oggEndOfStreamFlag) != 0;
+
+		// packets end on the first lacing value under 255, and can carry on into the next page.
+		auto body = (const unsigned char*)data.data() + offset + page.headerSize;
+		for(std::byte lacing : page.segments) {
+			packet.insert(packet.end(), body, body + (uint8_t)lacing);
+			body += (uint8_t)lacing;
+			if((uint8_t)lacing == 255) { continue; }
+			// OpusHead, then OpusTags, then audio.
+			if(packetNumber == 0) {
+				if(packet.size() < 19 || std::memcmp(packet.data(), "OpusHead", 8) != 0) {
+					return std::nullopt;
+				}
+				result.preskip = packet[10] | (packet[11] << 8);
+			} else if(packetNumber > 1) {
+				int32_t frames = opus_decode_float(decoder, packet.data(), (opus_int32)packet.size(),
+				                                   frame.data(), c_maxPacketFrames, 0);
+				if(frames < 0) { return std::nullopt; }
+				result.pcm.insert(result.pcm.end(), frame.data(),
+				                  frame.data() + frames * c_numOutputChannels);
+			}
+			packet.clear();
+			++packetNumber;
+		}
+	}
+	if(!endOfStream) { result.granulesValid = false; }
+
+	const uint64_t decodedFrames = result.pcm.size() / c_numOutputChannels;
+	if(packetNumber < 2 || result.finalGranule < (uint64_t)result.preskip ||
+	   decodedFrames < result.finalGranule) {
+		return std::nullopt;
+	}
+	result.pcm.resize(result.finalGranule * c_numOutputChannels);
+	result.pcm.erase(result.pcm.begin(), result.pcm.begin() + result.preskip * c_numOutputChannels);
+	return result;
+}
+
+// Encodes one file the way a long track is encoded on several workers, and again with a single
+// libopusenc encoder, decodes both and compares them. They are separate lossy encodes so they are
+// never identical, what matters is that the segmented one isn't any further from the single one
+// around a seam than it is anywhere else, and that both streams have the granules and preskip a
+// player needs to get the length right. The file has to be long enough to be split at least once.
+//
+// Closeness is signal to difference in dB over 100ms windows, quiet windows are left out since
+// almost any difference is large next to them. Fails if a seam window is more than 6dB below the
+// median of the whole track, or a whole segment is more than 6dB below the first one, which would
+// mean the segments were put together out of line.
+int RunSeamCheck(const fs::path& a_file) {
+	constexpr uint32_t c_numWorkers   = 4;
+	constexpr uint32_t c_windowFrames = c_targetSampleRate / 10;
+	constexpr double c_quietWindow    = 1e-6;
+	constexpr double c_maxDropDb      = 6.0;
+
+	if(!fs::exists(a_file)) {
+		fmt::print("{} doesn't exist\n", a_file.string());
+		return EXIT_FAILURE;
+	}
+	cep::MemoryMappedFile sourceFile(a_file);
+	if(!sourceFile.isValid()) {
+		fmt::print("{} could not be read, or is empty\n", a_file.string());
+		return EXIT_FAILURE;
+	}
+	FlacInfo flacInfo{};
+	MappedFlacStream flacStream{&sourceFile, &flacInfo};
+	drflac* drFlac = OpenFlac(flacStream);
+	if(drFlac == nullptr) {
+		fmt::print("{} could not be opened as a flac file\n", a_file.string());
+		return EXIT_FAILURE;
+	}
+	drflac_close(drFlac);
+	if(flacInfo.numFrames == 0 || cea::GetDownmixMatrix(flacInfo.numChannels) == nullptr) {
+		fmt::print("{} is not a supported flac file\n", a_file.string());
+		return EXIT_FAILURE;
+	}
+	const uint64_t outputFrames =
+	    (flacInfo.numFrames * c_targetSampleRate + flacInfo.sampleRate - 1) / flacInfo.sampleRate;
+	const uint64_t segmentFrames = SegmentFrames(outputFrames, c_numWorkers);
+	if(segmentFrames >= outputFrames) {
+		fmt::print("{} is too short to be split, it needs to be over {}s\n", a_file.string(),
+		           segmentFrames / c_targetSampleRate);
+		return EXIT_FAILURE;
+	}
+
+	// config isn't loaded, so this is the built in archive profile.
+	ConversionJob single;
+	single.source  = a_file;
+	single.dest    = fs::temp_directory_path() / "seam_check_single.opus";
+	single.profile = std::make_shared<const EncodeProfile>(encodeProfiles[selectedProfile]);
+	ConversionJob segmented = single;
+	segmented.dest          = fs::temp_directory_path() / "seam_check_segmented.opus";
+	auto removeOutputs      = cecore::defer([&] {
+		std::error_code ec;
+		fs::remove(single.dest, ec);
+		fs::remove(segmented.dest, ec);
+	});
+
+	// no workers yet, so this takes the single encoder path.
+	bool encoded = ConvertFile(single).has_value();
+	if(encoded) {
+		// this thread is one of the workers.
+		for(uint32_t i = 1; i < c_numWorkers; ++i) { workerThreads.emplace_back(WorkerMain); }
+		encoded = ConvertFileSegmented(segmented, sourceFile, flacInfo, outputFrames, c_numWorkers);
+		for(auto& worker : workerThreads) { worker.request_stop(); }
+		workerThreads.clear();
+	}
+	if(!encoded) {
+		fmt::print("{}", GetErrorLog());
+		return EXIT_FAILURE;
+	}
+
+	const auto singleDecoded    = DecodeOggOpus(single.dest);
+	const auto segmentedDecoded = DecodeOggOpus(segmented.dest);
+	if(!singleDecoded || !segmentedDecoded) {
+		fmt::print("an output could not be decoded\n");
+		return EXIT_FAILURE;
+	}
+	bool passed = true;
+	for(const auto& [name, decoded] : {std::pair{"single", &*singleDecoded},
+	                                   std::pair{"segmented", &*segmentedDecoded}}) {
+		const bool lengthRight = decoded->finalGranule == outputFrames + decoded->preskip;
+		fmt::print("{:<10} preskip {:5} final granule {:10} expected {:10} {}\n", name,
+		           decoded->preskip, decoded->finalGranule, outputFrames + decoded->preskip,
+		           decoded->granulesValid && lengthRight ? "ok" : "WRONG");
+		passed = passed && decoded->granulesValid && lengthRight;
+	}
+	if(singleDecoded->pcm.size() != segmentedDecoded->pcm.size()) {
+		fmt::print("decoded lengths differ\n");
+		return EXIT_FAILURE;
+	}
+
+	// signal to difference of the window starting at a_frame, empty if it is quiet.
+	auto windowDb = [&](uint64_t a_frame) -> std::optional<double> {
+		const size_t end = std::min<size_t>((a_frame + c_windowFrames) * c_numOutputChannels,
+		                                    singleDecoded->pcm.size());
+		double signal{};
+		double difference{};
+		for(size_t i = a_frame * c_numOutputChannels; i < end; ++i) {
+			const double reference = singleDecoded->pcm[i];
+			const double delta     = reference - segmentedDecoded->pcm[i];
+			signal += reference * reference;
+			difference += delta * delta;
+		}
+		if(signal < c_quietWindow * c_windowFrames) { return std::nullopt; }
+		return 10.0 * std::log10(signal / std::max(difference, 1e-20));
+	};
+	auto median = [](std::vector<double> a_values) {
+		if(a_values.empty()) { return 0.0; }
+		std::ranges::nth_element(a_values, a_values.begin() + a_values.size() / 2);
+		return a_values[a_values.size() / 2];
+	};
+
+	const auto numSegments = (uint32_t)((outputFrames + segmentFrames - 1) / segmentFrames);
+	std::vector<std::vector<double>> segmentWindows(numSegments);
+	std::vector<double> allWindows;
+	for(uint64_t frame = 0; frame + c_windowFrames <= outputFrames; frame += c_windowFrames) {
+		if(auto db = windowDb(frame)) {
+			segmentWindows[frame / segmentFrames].push_back(*db);
+			allWindows.push_back(*db);
+		}
+	}
+	const double trackDb = median(allWindows);
+	fmt::print("\n  {:<16} {:>10}\n", "window", "vs single");
+	fmt::print("  {:<16} {:>8.1f}dB\n", "track median", trackDb);
+	for(uint32_t segment = 0; segment < numSegments; ++segment) {
+		const double segmentDb = median(segmentWindows[segment]);
+		const bool ok          = segmentDb >= median(segmentWindows[0]) - c_maxDropDb;
+		fmt::print("  {:<16} {:>8.1f}dB {}\n", fmt::format("segment {}", segment), segmentDb,
+		           ok ? "" : "WRONG");
+		passed = passed && ok;
+	}
+	for(uint32_t segment = 1; segment < numSegments; ++segment) {
+		const std::string name = fmt::format("seam {:.0f}s", (double)segment * segmentFrames /
+		                                                         c_targetSampleRate);
+		// the windows either side of the seam.
+		for(uint64_t frame : {segment * segmentFrames - c_windowFrames, segment * segmentFrames}) {
+			const auto db = windowDb(frame);
+			if(!db) {
+				fmt::print("  {:<16} {:>10}\n", name, "quiet");
+				continue;
+			}
+			const bool ok = *db >= trackDb - c_maxDropDb;
+			fmt::print("  {:<16} {:>8.1f}dB {}\n", name, *db, ok ? "" : "WRONG");
+			passed = passed && ok;
+		}
+	}
+	fmt::print("{}\n", passed ? "passed" : "FAILED");
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+	// MusicConverter --benchmark-pcm <file.flac>... compares the float and 16 bit pcm paths.
+	if(argc >= 3 && std::string_view(argv[1]) == "--benchmark-pcm") {
+		return RunPcmBenchmark({argv + 2, argv + argc});
+	}
+	// MusicConverter --check-downmix checks the SIMD downmix kernels against the scalar one.
+	if(argc == 2 && std::string_view(argv[1]) == "--check-downmix") {
+		std::string log;
+		const bool passed = cea::CheckDownmixKernels(log);
+		fmt::print("{}{}\n", log, passed ? "passed" : "FAILED");
+		return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// MusicConverter --check-seams <file.flac> checks a segmented encode against a single one.
+	if(argc == 3 && std::string_view(argv[1]) == "--check-seams") {
+		return RunSeamCheck(argv[2]);
+	}
+
 	fs::current_path(cep::GetCurrentProcessPath());
 
 	LoadConfig();
 
+	// MusicConverter --dry-run prints what converting with the saved config would do, and how
+	// long it should take.
+	if(argc == 2 && std::string_view(argv[1]) == "--dry-run") {
+		sourcePathString = sourcePath.string();
+		destPathString   = destPath.string();
+		auto plan        = PlanCurrentSync();
+		fmt::print("{}", GetErrorLog());
+		if(!plan) { return EXIT_FAILURE; }
+		fmt::print("{}", DescribePlan(*plan, WorkerCount(), true));
+		return EXIT_SUCCESS;
+	}
+
 	if(!glfwInit()) { return EXIT_FAILURE; }
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -787,12 +3142,15 @@ int main(int, char**) {
 	sourcePathString = sourcePath.string();
 	destPathString   = destPath.string();
 
-	workerThread = std::jthread(WorkerMain);
+	const uint32_t numWorkers = WorkerCount();
+	workerThreads.reserve(numWorkers);
+	for(uint32_t i = 0; i < numWorkers; ++i) { workerThreads.emplace_back(WorkerMain); }
 
 	SetOperation("Idle");
 
 	while(!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
+		UpdateWatch();
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
@@ -810,9 +3168,10 @@ int main(int, char**) {
 		glfwSwapBuffers(window);
 	}
 
+	sourceWatcher.reset();
 	CancelConversion();
-	workerThread.request_stop();
-	workerThread.join();
+	for(auto& worker : workerThreads) { worker.request_stop(); }
+	workerThreads.clear();
 
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
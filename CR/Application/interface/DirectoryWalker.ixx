@@ -0,0 +1,32 @@
+export module CR.Application.DirectoryWalker;
+
+import std;
+
+export namespace CR::Application {
+	// Called once for every entry under the root, from whichever walker thread listed its parent.
+	// a_thread is that thread's index, less than the a_numThreads given to WalkDirectory, so results
+	// can be collected per thread without locking and merged afterwards. a_relPath is the entry's
+	// path relative to the root, built up as the walk descends rather than computed from the full
+	// path.
+	using WalkVisitor =
+	    std::function<void(uint32_t a_thread, const std::filesystem::directory_entry& a_entry,
+	                       const std::filesystem::path& a_relPath)>;
+
+	// A directory the walk couldn't list.
+	struct WalkError {
+		std::filesystem::path Path;
+		std::error_code Error;
+	};
+
+	// Visits everything under a_root using a_numThreads threads, the calling thread is one of them.
+	// Each thread lists one directory at a time and pushes the subdirectories it finds onto its own
+	// queue, threads that run out of work steal from the other queues. On a network filesystem that
+	// keeps a_numThreads directory listings in flight instead of one. Directory symlinks are not
+	// followed, same as recursive_directory_iterator, nor is anything whose type can't be read, like
+	// a directory deleted during the walk. Stops at the first directory any thread can't list, since
+	// a partial walk would look like everything under it was deleted, and returns it once all of
+	// them have stopped. Empty if the whole tree was walked.
+	[[nodiscard]] std::optional<WalkError> WalkDirectory(const std::filesystem::path& a_root,
+	                                                     uint32_t a_numThreads,
+	                                                     const WalkVisitor& a_visitor);
+}    // namespace CR::Application
@@ -0,0 +1,40 @@
+export module CR.Application.Downmix;
+
+import std;
+
+export namespace CR::Application {
+	constexpr uint32_t c_maxDownmixChannels = 8;
+
+	// Weights for mixing one source channel layout down to interleaved stereo. Left and Right hold
+	// one weight per source channel, unused channels are 0. LeftFixed and RightFixed are the same
+	// weights in Q15 for the integer downmix.
+	struct DownmixMatrix {
+		uint32_t NumChannels{};
+		std::array<float, c_maxDownmixChannels> Left{};
+		std::array<float, c_maxDownmixChannels> Right{};
+		std::array<int32_t, c_maxDownmixChannels> LeftFixed{};
+		std::array<int32_t, c_maxDownmixChannels> RightFixed{};
+	};
+
+	// Matrix for the default flac channel layout with a_numChannels channels. nullptr if there isn't
+	// a layout for that many channels.
+	[[nodiscard]] const DownmixMatrix* GetDownmixMatrix(uint32_t a_numChannels);
+
+	// a_src is a_numFrames interleaved frames of a_matrix.NumChannels channels, a_dest gets
+	// a_numFrames interleaved stereo frames. Uses the fastest kernel the cpu supports.
+	void Downmix(const DownmixMatrix& a_matrix, const float* a_src, float* a_dest,
+	             uint32_t a_numFrames);
+
+	// 16 bit version of the above, for sources that don't need to go through float at all. Rounds
+	// and saturates to 16 bits.
+	void Downmix(const DownmixMatrix& a_matrix, const int16_t* a_src, int16_t* a_dest,
+	             uint32_t a_numFrames);
+
+	// Name of the kernel Downmix picked for this cpu.
+	[[nodiscard]] const char* GetDownmixKernelName();
+
+	// Runs every float kernel this cpu supports on random input, for every channel count and a
+	// range of frame counts, and checks each one matches the scalar kernel to within float
+	// rounding. a_log gets a line per kernel and channel count. False on any mismatch.
+	[[nodiscard]] bool CheckDownmixKernels(std::string& a_log);
+}    // namespace CR::Application
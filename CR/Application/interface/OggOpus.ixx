@@ -0,0 +1,41 @@
+export module CR.Application.OggOpus;
+
+import std;
+
+export namespace CR::Application {
+	// Packs opus packets into ogg pages the same way libopusenc does. For streams put together from
+	// packets that were encoded somewhere else, like segments encoded in parallel.
+	class OggPacker final {
+	public:
+		explicit OggPacker(uint32_t a_serial);
+		~OggPacker();
+		OggPacker(const OggPacker&)            = delete;
+		OggPacker& operator=(const OggPacker&) = delete;
+
+		// false if the packer couldn't be allocated.
+		[[nodiscard]] bool isValid() const;
+
+		// most granule positions, in 48k samples, a page holds before it is ended.
+		void SetMuxingDelay(uint64_t a_delay);
+		// false if out of memory.
+		[[nodiscard]] bool AddPacket(std::span<const unsigned char> a_packet, uint64_t a_granule,
+		                             bool a_endOfStream);
+		// ends the current page even if it isn't full.
+		void Flush();
+		// next finished page, only valid until the next call to AddPacket or NextPage. False when
+		// there are no more.
+		[[nodiscard]] bool NextPage(std::span<const unsigned char>& a_page);
+
+	private:
+		std::unique_ptr<struct OggPackerData> m_data;
+	};
+
+	// OpusHead packet for a channel mapping family 0 stream. Empty if a_channels isn't 1 or 2.
+	std::vector<unsigned char> BuildOpusHead(int32_t a_channels, int32_t a_preskip,
+	                                         uint32_t a_inputSampleRate);
+	// OpusTags packet holding a_comments, with at least a_padding bytes of zeros on the end so the
+	// tags can be edited later without the packet growing. Comments without an '=' are skipped.
+	// Empty if out of memory.
+	std::vector<unsigned char> BuildOpusTags(const std::vector<std::string>& a_comments,
+	                                         int32_t a_padding);
+}    // namespace CR::Application
@@ -0,0 +1,86 @@
+export module CR.Application.SyncManifest;
+
+import CR.Engine;
+
+import std;
+
+export namespace CR::Application {
+	struct PathHash {
+		size_t operator()(const std::filesystem::path& a_path) const noexcept {
+			return std::filesystem::hash_value(a_path);
+		}
+	};
+
+	using Md5Digest = std::array<std::byte, 16>;
+
+	// What the last run left in the destination for one source file or directory.
+	struct ManifestEntry {
+		bool IsDirectory{};
+		// of the source file when it was converted or copied, used to tell if it changed since.
+		uint64_t Size{};
+		int64_t LastWriteTime{};
+		// MD5 of the decoded audio from the flac STREAMINFO block, all 0 for anything else or if the
+		// file didn't have one.
+		Md5Digest ContentId{};
+		// relative to the destination root
+		std::filesystem::path Output;
+		// encode profile name, empty for copied files, directories, and outputs from before there was
+		// a manifest.
+		std::string Profile;
+	};
+
+	struct SyncManifest {
+		// a manifest only describes the destination for this pair of roots.
+		std::filesystem::path SourceRoot;
+		std::filesystem::path DestRoot;
+		// keyed by source path relative to SourceRoot
+		std::unordered_map<std::filesystem::path, ManifestEntry, PathHash> Entries;
+	};
+
+	// Empty if a_path doesn't exist, is from a different version, or is damaged.
+	std::optional<SyncManifest> LoadManifest(const std::filesystem::path& a_path);
+	// Writes a temp file next to a_path and renames it over, so a crash never leaves half of one.
+	bool SaveManifest(const std::filesystem::path& a_path, const SyncManifest& a_manifest);
+
+	// Append only record of a run in progress, so if it is interrupted the next run can pick up
+	// from where it stopped. Every record is flushed as it is written. Thread safe.
+	class SyncJournal final {
+	public:
+		// Replaces anything already at a_path.
+		SyncJournal(const std::filesystem::path& a_path, const std::filesystem::path& a_sourceRoot,
+		            const std::filesystem::path& a_destRoot);
+
+		SyncJournal(const SyncJournal&)            = delete;
+		SyncJournal& operator=(const SyncJournal&) = delete;
+
+		bool isValid() const { return m_file.asFile() != nullptr && !m_failed; }
+
+		// a_output, relative to the destination root, is about to be written for a_key. To a
+		// ".partial" file next to it and then renamed into place, unless a_inPlace.
+		void Begin(const std::filesystem::path& a_key, const std::filesystem::path& a_output,
+		           bool a_inPlace);
+		void Complete(const std::filesystem::path& a_key, const ManifestEntry& a_entry);
+		void Remove(const std::filesystem::path& a_key);
+
+	private:
+		void Append(const std::vector<std::byte>& a_record);
+
+		std::mutex m_mutex;
+		CR::Engine::Core::FileHandle m_file;
+		bool m_failed{};
+	};
+
+	struct UnfinishedOutput {
+		// relative to the destination root
+		std::filesystem::path Output;
+		bool InPlace{};
+	};
+
+	// Applies the journal at a_path, left by a run that was interrupted, to a_manifest, which has to
+	// be the manifest that run started from. Outputs the run started but didn't finish go in
+	// a_unfinished, and any in place ones are dropped from a_manifest since they could be half
+	// written. A record cut short by the interruption is ignored. False if there is no journal, or
+	// it is for different roots than a_manifest.
+	bool ReplayJournal(const std::filesystem::path& a_path, SyncManifest& a_manifest,
+	                   std::vector<UnfinishedOutput>& a_unfinished);
+}    // namespace CR::Application
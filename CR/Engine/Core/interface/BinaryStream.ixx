@@ -21,8 +21,8 @@ export namespace CR::Engine::Core {
 		} else {
 			Write(a_stream, (uint32_t)a_arg.size());
 			auto offset = a_stream.size();
-			a_stream.resize(a_stream.size() + a_arg.size() * sizeof(T::value_type));
-			memcpy(a_stream.data() + offset, a_arg.data(), a_arg.size() * sizeof(T::value_type));
+			a_stream.resize(a_stream.size() + a_arg.size() * sizeof(typename T::value_type));
+			memcpy(a_stream.data() + offset, a_arg.data(), a_arg.size() * sizeof(typename T::value_type));
 			return offset;
 		}
 	}
@@ -33,7 +33,7 @@ export namespace CR::Engine::Core {
 			fwrite(&a_arg, sizeof(T), 1, a_file.asFile());
 		} else {
 			Write(a_file, (uint32_t)a_arg.size());
-			fwrite(a_arg.data(), sizeof(T::value_type), a_arg.size(), a_file);
+			fwrite(a_arg.data(), sizeof(typename T::value_type), a_arg.size(), a_file.asFile());
 		}
 	}
 
@@ -68,8 +68,8 @@ export namespace CR::Engine::Core {
 			                "Tried to read past the end of the buffer");
 
 			a_out.resize(outSize);
-			memcpy(a_out.data(), a_stream.Data + a_stream.Offset, outSize * sizeof(T::value_type));
-			a_stream.Offset += outSize * sizeof(T::value_type);
+			memcpy(a_out.data(), a_stream.Data + a_stream.Offset, outSize * sizeof(typename T::value_type));
+			a_stream.Offset += outSize * sizeof(typename T::value_type);
 			return true;
 		}
 	}
@@ -69,7 +69,11 @@ namespace CR::Engine::Core {
 			fmt::println(fmt::runtime(buffer), std::forward<ArgTs>(a_args)...);
 			GetLogger()->error(fmt::runtime(buffer), std::forward<ArgTs>(a_args)...);
 			GetLogger()->flush();
+#if defined(_MSC_VER)
 			__debugbreak();
+#else
+			__builtin_trap();
+#endif
 			std::terminate();
 		}
 	}    // namespace Log
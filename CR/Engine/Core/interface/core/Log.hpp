@@ -1,6 +1,18 @@
 #pragma once
 import CR.Engine.Core.Log;
 
+// Lets the optimizer take condition as true.
+#if defined(_MSC_VER)
+#define CR_ASSUME(condition) __assume(condition)
+#elif defined(__clang__)
+#define CR_ASSUME(condition) __builtin_assume(condition)
+#else
+#define CR_ASSUME(condition)                                                                       \
+	do {                                                                                             \
+		if(!(condition)) { __builtin_unreachable(); }                                                  \
+	} while(false)
+#endif
+
 #define CR_ERROR(fmtString, ...)                                                                   \
 	do {                                                                                             \
 		CR::Engine::Core::Log::Error(std::source_location::current(),                                  \
@@ -37,11 +49,11 @@ import CR.Engine.Core.Log;
 	do {                                                                                             \
 		if(!(condition)) { CR_ERROR(fmtString __VA_OPT__(, ) __VA_ARGS__); }                           \
 	} while(false);                                                                                  \
-	__assume(!(condition));
+	CR_ASSUME(condition);
 
 #else
 
-#define CR_ASSERT_AUDIT(condition, fmtString, ...) __assume(!(condition));
+#define CR_ASSERT_AUDIT(condition, fmtString, ...) CR_ASSUME(condition);
 
 #endif
 
@@ -55,7 +67,7 @@ import CR.Engine.Core.Log;
 	do {                                                                                             \
 		if(!(condition)) { CR_ERROR(fmtString __VA_OPT__(, ) __VA_ARGS__); }                           \
 	} while(false);                                                                                  \
-	//__assume(!(condition));
+	// CR_ASSUME(condition);
 
 #define CR_REQUIRES(condition, fmtString, ...)                                                     \
 	CR_ASSERT(condition, fmtString __VA_OPT__(, ) __VA_ARGS__);
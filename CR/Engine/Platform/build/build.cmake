@@ -6,19 +6,37 @@ set(root "${CMAKE_CURRENT_LIST_DIR}/..")
 #library
 ###############################################
 set(CR_INTERFACE_HEADERS
-    ${root}/interface/platform/windows/CRWindows.h 
 )
+if(WIN32)
+    list(APPEND CR_INTERFACE_HEADERS ${root}/interface/platform/windows/CRWindows.h)
+endif()
 
 set(CR_INTERFACE_MODULES
+    ${root}/interface/DirectoryWatcher.ixx
+    ${root}/interface/FileCopy.ixx
+    ${root}/interface/FilePrefetch.ixx
     ${root}/interface/MemoryMappedFile.ixx
     ${root}/interface/PathUtils.ixx
     ${root}/interface/Platform.ixx
 )
 
-set(CR_IMPLEMENTATION
-    ${root}/implementation/windows/MemoryMappedFile.cxx
-    ${root}/implementation/windows/PathUtils.cxx
-)
+if(WIN32)
+    set(CR_IMPLEMENTATION
+        ${root}/implementation/windows/DirectoryWatcher.cxx
+        ${root}/implementation/windows/FileCopy.cxx
+        ${root}/implementation/windows/FilePrefetch.cxx
+        ${root}/implementation/windows/MemoryMappedFile.cxx
+        ${root}/implementation/windows/PathUtils.cxx
+    )
+else()
+    set(CR_IMPLEMENTATION
+        ${root}/implementation/linux/DirectoryWatcher.cxx
+        ${root}/implementation/linux/FileCopy.cxx
+        ${root}/implementation/linux/FilePrefetch.cxx
+        ${root}/implementation/linux/MemoryMappedFile.cxx
+        ${root}/implementation/linux/PathUtils.cxx
+    )
+endif()
 
 set(CR_BUILD_FILES
     ${root}/build/build.cmake
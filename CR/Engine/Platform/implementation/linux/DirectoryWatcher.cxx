@@ -0,0 +1,178 @@
+module;
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+module CR.Engine.Platform.DirectoryWatcher;
+
+import std;
+
+namespace fs = std::filesystem;
+
+namespace CR::Engine::Platform {
+	struct DirectoryWatcherData {
+		~DirectoryWatcherData() {
+			// the scanner adds watches to m_inotify, it has to stop before that is closed.
+			if(m_scanner.joinable()) {
+				m_scanner.request_stop();
+				m_scanner.join();
+			}
+			if(m_inotify != -1) { close(m_inotify); }
+		}
+
+		int m_inotify{-1};
+		fs::path m_root;
+
+		// everything below is shared with m_scanner.
+		std::mutex m_mutex;
+		// inotify isn't recursive, one watch per folder, mapped to the folder relative to m_root.
+		std::unordered_map<int, fs::path> m_folders;
+		// ran out of watches or the kernel queue overflowed, reported on the next Poll.
+		bool m_missedEvents{};
+		// folders, relative to m_root, whose sub folders still need watches. Walking a big tree
+		// takes a while, so m_scanner does it rather than whoever is calling Poll.
+		std::deque<fs::path> m_toScan;
+		std::condition_variable_any m_scanQueued;
+		std::jthread m_scanner;
+	};
+}    // namespace CR::Engine::Platform
+
+namespace cep = CR::Engine::Platform;
+
+namespace {
+	// IN_ATTRIB catches touch and anything else that only changes the write time.
+	constexpr uint32_t c_watchMask = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_ATTRIB |
+	                                 IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW |
+	                                 IN_EXCL_UNLINK;
+
+	bool IsWithin(const fs::path& a_path, const fs::path& a_folder) {
+		auto [folderEnd, pathEnd] = std::ranges::mismatch(a_folder, a_path);
+		return folderEnd == a_folder.end();
+	}
+
+	// call with m_mutex held.
+	void AddWatch(cep::DirectoryWatcherData& a_data, const fs::path& a_relFolder) {
+		int watch = inotify_add_watch(a_data.m_inotify, (a_data.m_root / a_relFolder).c_str(),
+		                              c_watchMask);
+		if(watch == -1) {
+			// usually hit max_user_watches, or the folder is already gone again.
+			if(errno != ENOENT) { a_data.m_missedEvents = true; }
+			return;
+		}
+		a_data.m_folders.insert_or_assign(watch, a_relFolder);
+	}
+
+	// Watches the folder straight away, and queues its sub folders for the scanner. Files can land in
+	// a new folder before its watch exists, that is fine since the folder itself is reported, which
+	// covers everything under it. Call with m_mutex held.
+	void AddWatches(cep::DirectoryWatcherData& a_data, const fs::path& a_relFolder) {
+		AddWatch(a_data, a_relFolder);
+		a_data.m_toScan.push_back(a_relFolder);
+		a_data.m_scanQueued.notify_one();
+	}
+
+	void ScannerMain(std::stop_token a_stop, cep::DirectoryWatcherData& a_data) {
+		while(true) {
+			fs::path relFolder;
+			{
+				std::unique_lock lock(a_data.m_mutex);
+				if(!a_data.m_scanQueued.wait(lock, a_stop, [&] { return !a_data.m_toScan.empty(); })) {
+					return;
+				}
+				relFolder = std::move(a_data.m_toScan.front());
+				a_data.m_toScan.pop_front();
+			}
+			// only locked per watch, so Poll isn't held up for the whole walk.
+			std::error_code ec;
+			for(fs::recursive_directory_iterator folder(
+			        a_data.m_root / relFolder, fs::directory_options::skip_permission_denied, ec);
+			    !ec && folder != fs::recursive_directory_iterator(); folder.increment(ec)) {
+				if(a_stop.stop_requested()) { return; }
+				if(folder->is_directory(ec) && !folder->is_symlink(ec)) {
+					std::scoped_lock lock(a_data.m_mutex);
+					AddWatch(a_data, folder->path().lexically_relative(a_data.m_root));
+				}
+			}
+		}
+	}
+
+	// a folder moved away, its watches still exist but would report under the old name. Call with
+	// m_mutex held.
+	void RemoveWatches(cep::DirectoryWatcherData& a_data, const fs::path& a_relFolder) {
+		std::erase_if(a_data.m_folders, [&](const auto& a_folder) {
+			if(!IsWithin(a_folder.second, a_relFolder)) { return false; }
+			inotify_rm_watch(a_data.m_inotify, a_folder.first);
+			return true;
+		});
+	}
+}    // namespace
+
+cep::DirectoryWatcher::DirectoryWatcher() {}
+
+cep::DirectoryWatcher::DirectoryWatcher(const fs::path& a_root) {
+	int inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify == -1) { return; }
+
+	m_watchData            = std::make_unique<DirectoryWatcherData>();
+	m_watchData->m_inotify = inotify;
+	m_watchData->m_root    = a_root;
+	AddWatch(*m_watchData, fs::path{});
+	if(m_watchData->m_folders.empty()) {
+		m_watchData.reset();
+		return;
+	}
+	// the rest of the tree is watched in the background, a big library takes a while to walk.
+	m_watchData->m_toScan.push_back(fs::path{});
+	m_watchData->m_scanner = std::jthread(ScannerMain, std::ref(*m_watchData));
+}
+
+cep::DirectoryWatcher::~DirectoryWatcher() = default;
+
+cep::DirectoryWatcher::DirectoryWatcher(DirectoryWatcher&& a_other) noexcept {
+	*this = std::move(a_other);
+}
+
+cep::DirectoryWatcher& cep::DirectoryWatcher::operator=(DirectoryWatcher&& a_other) noexcept {
+	if(this == &a_other) { return *this; }
+	m_watchData = std::move(a_other.m_watchData);
+	return *this;
+}
+
+bool cep::DirectoryWatcher::Poll(std::vector<fs::path>& a_changed) {
+	if(!m_watchData) { return true; }
+
+	alignas(inotify_event) std::byte buffer[64 * 1024];
+	while(true) {
+		ssize_t length = read(m_watchData->m_inotify, buffer, sizeof(buffer));
+		// EAGAIN once the queue is empty
+		if(length <= 0) { break; }
+
+		std::scoped_lock lock(m_watchData->m_mutex);
+		for(ssize_t offset = 0; offset < length;) {
+			const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			if(event->mask & IN_Q_OVERFLOW) {
+				m_watchData->m_missedEvents = true;
+				continue;
+			}
+			if(event->mask & IN_IGNORED) {
+				m_watchData->m_folders.erase(event->wd);
+				continue;
+			}
+			auto folder = m_watchData->m_folders.find(event->wd);
+			// events about the watched folder itself also show up on its parent, with a name.
+			if(folder == m_watchData->m_folders.end() || event->len == 0) { continue; }
+
+			fs::path relPath = folder->second / event->name;
+			if(event->mask & IN_ISDIR) {
+				if(event->mask & IN_MOVED_FROM) { RemoveWatches(*m_watchData, relPath); }
+				if(event->mask & (IN_CREATE | IN_MOVED_TO)) { AddWatches(*m_watchData, relPath); }
+			}
+			a_changed.push_back(std::move(relPath));
+		}
+	}
+
+	std::scoped_lock lock(m_watchData->m_mutex);
+	return !std::exchange(m_watchData->m_missedEvents, false);
+}
@@ -0,0 +1,80 @@
+module;
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+module CR.Engine.Platform.FileCopy;
+
+import std;
+
+namespace fs = std::filesystem;
+
+namespace {
+	struct FileDescriptor {
+		~FileDescriptor() {
+			if(m_fd != -1) { close(m_fd); }
+		}
+
+		int m_fd{-1};
+	};
+
+	// copy_file_range keeps the copy in the kernel, and on the same filesystem lets it do the copy
+	// itself, like a server side copy on nfs or smb. Kernels before 5.19 won't use it across
+	// filesystems, and some filesystems don't support it at all, sendfile works for those.
+	bool KernelCopy(int a_from, int a_to, uint64_t a_size) {
+		bool useSendfile = false;
+		while(a_size > 0) {
+			const ssize_t copied = useSendfile
+			                           ? sendfile(a_to, a_from, nullptr, a_size)
+			                           : copy_file_range(a_from, nullptr, a_to, nullptr, a_size, 0);
+			if(copied == -1) {
+				if(errno == EINTR) { continue; }
+				if(!useSendfile &&
+				   (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+					// both advance the file offsets, so sendfile carries on from where this stopped.
+					useSendfile = true;
+					continue;
+				}
+				return false;
+			}
+			// source got shorter since it was opened.
+			if(copied == 0) { break; }
+			a_size -= (uint64_t)copied;
+		}
+		return true;
+	}
+}    // namespace
+
+bool CR::Engine::Platform::CloneOrCopyFile(const fs::path& a_from, const fs::path& a_to,
+                                           std::error_code& a_error) {
+	a_error.clear();
+	auto failed = [&] {
+		a_error.assign(errno, std::generic_category());
+		return false;
+	};
+
+	FileDescriptor from{open(a_from.c_str(), O_RDONLY | O_CLOEXEC)};
+	if(from.m_fd == -1) { return failed(); }
+	struct stat fromStat{};
+	if(fstat(from.m_fd, &fromStat) == -1) { return failed(); }
+
+	FileDescriptor to{open(a_to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+	                       fromStat.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO))};
+	if(to.m_fd == -1) { return failed(); }
+
+	// only works within one filesystem that supports it, btrfs, xfs, bcachefs and the like. Shares
+	// the source's extents, so it takes the same time no matter how big the file is.
+	if(ioctl(to.m_fd, FICLONE, from.m_fd) != 0 &&
+	   !KernelCopy(from.m_fd, to.m_fd, (uint64_t)fromStat.st_size)) {
+		return failed();
+	}
+
+	// a network filesystem can report a failed write only on close.
+	const int toFd = std::exchange(to.m_fd, -1);
+	if(close(toFd) == -1) { return failed(); }
+	return true;
+}
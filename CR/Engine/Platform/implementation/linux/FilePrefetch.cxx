@@ -0,0 +1,37 @@
+module;
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+module CR.Engine.Platform.FilePrefetch;
+
+import std;
+
+bool CR::Engine::Platform::PrefetchFile(const std::filesystem::path& a_path) {
+	int file = open(a_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(file == -1) { return false; }
+	struct stat fileStat{};
+	if(fstat(file, &fileStat) == -1) {
+		close(file);
+		return false;
+	}
+	// queues the reads and returns, the page cache keeps them after the close. Works on nfs and cifs
+	// mounts too. Each call only reads up to the device's readahead size, so go in pieces no bigger
+	// than the usual default.
+	constexpr off_t c_chunkSize = 128 * 1024;
+	for(off_t offset = 0; offset < fileStat.st_size; offset += c_chunkSize) {
+		posix_fadvise(file, offset, c_chunkSize, POSIX_FADV_WILLNEED);
+	}
+	close(file);
+	return true;
+}
+
+bool CR::Engine::Platform::EvictFile(const std::filesystem::path& a_path) {
+	int file = open(a_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(file == -1) { return false; }
+	// only clean pages are dropped, anything still waiting to be written stays.
+	posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+	close(file);
+	return true;
+}
@@ -0,0 +1,101 @@
+module;
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+module CR.Engine.Platform.MemoryMappedFile;
+
+import std;
+
+namespace CR::Engine::Platform {
+	struct MemoryMappedFileData {
+		std::byte* m_data{nullptr};
+		std::size_t m_fileSize{0};
+	};
+}    // namespace CR::Engine::Platform
+
+namespace cep = CR::Engine::Platform;
+
+cep::MemoryMappedFile::MemoryMappedFile() {}
+
+cep::MemoryMappedFile::MemoryMappedFile(const std::filesystem::path& a_filePath, bool a_populate) {
+	int file = open(a_filePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if(file == -1) { return; }
+
+	struct stat fileStat{};
+	void* data = MAP_FAILED;
+	if(fstat(file, &fileStat) == 0 && fileStat.st_size != 0) {
+		data = mmap(nullptr, (std::size_t)fileStat.st_size, PROT_READ,
+		            MAP_PRIVATE | (a_populate ? MAP_POPULATE : 0), file, 0);
+	}
+	// the mapping keeps its own reference to the file.
+	close(file);
+	if(data == MAP_FAILED) { return; }
+
+	m_fileData             = std::make_unique<MemoryMappedFileData>();
+	m_fileData->m_data     = (std::byte*)data;
+	m_fileData->m_fileSize = (std::size_t)fileStat.st_size;
+}
+
+cep::MemoryMappedFile::~MemoryMappedFile() {
+	if(m_fileData) { munmap(m_fileData->m_data, m_fileData->m_fileSize); }
+}
+
+cep::MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& a_other) noexcept {
+	*this = std::move(a_other);
+}
+
+cep::MemoryMappedFile& cep::MemoryMappedFile::operator=(MemoryMappedFile&& a_other) noexcept {
+	if(this == &a_other) { return *this; }
+	if(m_fileData) { munmap(m_fileData->m_data, m_fileData->m_fileSize); }
+	m_fileData = std::move(a_other.m_fileData);
+	return *this;
+}
+
+std::size_t cep::MemoryMappedFile::size() const noexcept {
+	if(!m_fileData) { return 0; }
+	return m_fileData->m_fileSize;
+}
+
+std::byte* cep::MemoryMappedFile::data() noexcept {
+	if(!m_fileData) { return nullptr; }
+	return m_fileData->m_data;
+}
+
+const std::byte* cep::MemoryMappedFile::data() const noexcept {
+	if(!m_fileData) { return nullptr; }
+	return m_fileData->m_data;
+}
+
+void cep::MemoryMappedFile::SetAccessHint(AccessHint a_hint) {
+	if(!m_fileData) { return; }
+	int advice = MADV_NORMAL;
+	if(a_hint == AccessHint::Sequential) {
+		advice = MADV_SEQUENTIAL;
+	} else if(a_hint == AccessHint::Random) {
+		advice = MADV_RANDOM;
+	}
+	madvise(m_fileData->m_data, m_fileData->m_fileSize, advice);
+}
+
+void cep::MemoryMappedFile::Prefetch(std::size_t a_offset, std::size_t a_size) {
+	if(!m_fileData || a_offset >= m_fileData->m_fileSize) { return; }
+	// madvise needs a page aligned start.
+	const std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+	const std::size_t start    = a_offset - a_offset % pageSize;
+	const std::size_t end      = a_offset + std::min(a_size, m_fileData->m_fileSize - a_offset);
+	madvise(m_fileData->m_data + start, end - start, MADV_WILLNEED);
+}
+
+void cep::MemoryMappedFile::Release(std::size_t a_offset, std::size_t a_size) {
+	if(!m_fileData || a_offset >= m_fileData->m_fileSize) { return; }
+	const std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+	const std::size_t start    = (a_offset + pageSize - 1) / pageSize * pageSize;
+	const std::size_t end = std::min(a_offset + a_size, m_fileData->m_fileSize) / pageSize * pageSize;
+	if(start >= end) { return; }
+	// mapping is private and read only, so nothing is lost. The pages stay in the page cache, they
+	// just aren't counted against this process anymore.
+	madvise(m_fileData->m_data + start, end - start, MADV_DONTNEED);
+}
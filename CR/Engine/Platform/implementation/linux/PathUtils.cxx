@@ -0,0 +1,12 @@
+module CR.Engine.Platform.PathUtils;
+
+import std;
+
+namespace fs = std::filesystem;
+
+std::filesystem::path CR::Engine::Platform::GetCurrentProcessPath() {
+	std::error_code ec;
+	fs::path pathOnly = fs::read_symlink("/proc/self/exe", ec);
+	pathOnly          = pathOnly.parent_path();
+	return pathOnly;
+}
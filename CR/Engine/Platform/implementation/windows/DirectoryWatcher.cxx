@@ -0,0 +1,112 @@
+module;
+
+#include <platform/windows/CRWindows.h>
+
+module CR.Engine.Platform.DirectoryWatcher;
+
+import std;
+
+namespace fs = std::filesystem;
+
+namespace CR::Engine::Platform {
+	struct DirectoryWatcherData {
+		HANDLE m_folder{INVALID_HANDLE_VALUE};
+		OVERLAPPED m_overlapped{};
+		// FILE_NOTIFY_INFORMATION has to be DWORD aligned
+		alignas(DWORD) std::byte m_buffer[64 * 1024];
+		bool m_readPending{};
+		// a read couldn't be issued, or the buffer overflowed, reported on the next Poll.
+		bool m_missedEvents{};
+	};
+}    // namespace CR::Engine::Platform
+
+namespace cep = CR::Engine::Platform;
+
+namespace {
+	constexpr DWORD c_notifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+	                                 FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+
+	bool IssueRead(cep::DirectoryWatcherData& a_data) {
+		ResetEvent(a_data.m_overlapped.hEvent);
+		return ReadDirectoryChangesW(a_data.m_folder, a_data.m_buffer, sizeof(a_data.m_buffer), TRUE,
+		                             c_notifyFilter, nullptr, &a_data.m_overlapped, nullptr);
+	}
+}    // namespace
+
+cep::DirectoryWatcher::DirectoryWatcher() {}
+
+cep::DirectoryWatcher::DirectoryWatcher(const fs::path& a_root) {
+	auto handle = CreateFileW(a_root.c_str(), FILE_LIST_DIRECTORY,
+	                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+	                          OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+	if(handle == INVALID_HANDLE_VALUE) { return; }
+
+	m_watchData                      = std::make_unique<DirectoryWatcherData>();
+	m_watchData->m_folder            = handle;
+	m_watchData->m_overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	m_watchData->m_readPending       = IssueRead(*m_watchData);
+	if(!m_watchData->m_readPending) {
+		CloseHandle(m_watchData->m_overlapped.hEvent);
+		CloseHandle(handle);
+		m_watchData.reset();
+	}
+}
+
+cep::DirectoryWatcher::~DirectoryWatcher() {
+	if(m_watchData) {
+		// the read in flight writes into m_buffer, has to be finished before that goes away.
+		if(m_watchData->m_readPending) {
+			DWORD bytes{};
+			CancelIoEx(m_watchData->m_folder, &m_watchData->m_overlapped);
+			GetOverlappedResult(m_watchData->m_folder, &m_watchData->m_overlapped, &bytes, TRUE);
+		}
+		CloseHandle(m_watchData->m_overlapped.hEvent);
+		CloseHandle(m_watchData->m_folder);
+	}
+}
+
+cep::DirectoryWatcher::DirectoryWatcher(DirectoryWatcher&& a_other) noexcept {
+	*this = std::move(a_other);
+}
+
+cep::DirectoryWatcher& cep::DirectoryWatcher::operator=(DirectoryWatcher&& a_other) noexcept {
+	if(this == &a_other) { return *this; }
+	m_watchData = std::move(a_other.m_watchData);
+	return *this;
+}
+
+bool cep::DirectoryWatcher::Poll(std::vector<fs::path>& a_changed) {
+	if(!m_watchData) { return true; }
+
+	while(true) {
+		if(!m_watchData->m_readPending) {
+			m_watchData->m_readPending = IssueRead(*m_watchData);
+			if(!m_watchData->m_readPending) {
+				m_watchData->m_missedEvents = true;
+				break;
+			}
+		}
+		DWORD bytes{};
+		if(!GetOverlappedResult(m_watchData->m_folder, &m_watchData->m_overlapped, &bytes, FALSE)) {
+			if(GetLastError() == ERROR_IO_INCOMPLETE) { break; }
+			// ERROR_NOTIFY_ENUM_DIR and friends, changes were lost. Read again next time.
+			m_watchData->m_readPending  = false;
+			m_watchData->m_missedEvents = true;
+			break;
+		}
+		m_watchData->m_readPending = false;
+
+		// 0 bytes means the buffer overflowed and the changes were thrown away.
+		if(bytes == 0) { m_watchData->m_missedEvents = true; }
+		for(DWORD offset = 0; offset < bytes;) {
+			const auto* info =
+			    reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(m_watchData->m_buffer + offset);
+			a_changed.emplace_back(
+			    std::wstring_view(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+			if(info->NextEntryOffset == 0) { break; }
+			offset += info->NextEntryOffset;
+		}
+	}
+
+	return !std::exchange(m_watchData->m_missedEvents, false);
+}
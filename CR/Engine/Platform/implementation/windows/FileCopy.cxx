@@ -0,0 +1,25 @@
+module;
+
+#include <platform/windows/CRWindows.h>
+
+module CR.Engine.Platform.FileCopy;
+
+import std;
+
+namespace fs = std::filesystem;
+
+bool CR::Engine::Platform::CloneOrCopyFile(const fs::path& a_from, const fs::path& a_to,
+                                           std::error_code& a_error) {
+	a_error.clear();
+	// CopyFile2 block clones on its own where the volume supports it, ReFS and Dev Drives, and
+	// otherwise copies in the system without the data coming through this process.
+	COPYFILE2_EXTENDED_PARAMETERS parameters{};
+	parameters.dwSize      = sizeof(parameters);
+	parameters.dwCopyFlags = 0;
+	const HRESULT result   = CopyFile2(a_from.c_str(), a_to.c_str(), &parameters);
+	if(FAILED(result)) {
+		a_error.assign(HRESULT_CODE(result), std::system_category());
+		return false;
+	}
+	return true;
+}
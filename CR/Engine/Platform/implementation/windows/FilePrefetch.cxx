@@ -0,0 +1,43 @@
+module;
+
+#include <platform/windows/CRWindows.h>
+
+module CR.Engine.Platform.FilePrefetch;
+
+import std;
+
+bool CR::Engine::Platform::PrefetchFile(const std::filesystem::path& a_path) {
+	auto handle = CreateFileW(a_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if(handle == INVALID_HANDLE_VALUE) { return false; }
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+	HANDLE mapping = CreateFileMapping(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(handle);
+	if(mapping == nullptr) { return false; }
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(view == nullptr) { return false; }
+
+	// the reads belong to the file, not the view. They carry on after it is unmapped and the pages
+	// end up on the standby list, which is where a later mapping of the file finds them.
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = view;
+	range.NumberOfBytes  = (std::size_t)fileSize.QuadPart;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	UnmapViewOfFile(view);
+	return true;
+}
+
+bool CR::Engine::Platform::EvictFile(const std::filesystem::path& a_path) {
+	// opening a file non buffered makes the cache manager flush and purge what it has cached of it,
+	// as long as no one else has it mapped.
+	auto handle = CreateFileW(a_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_FLAG_NO_BUFFERING, 0);
+	if(handle == INVALID_HANDLE_VALUE) { return false; }
+	CloseHandle(handle);
+	return true;
+}
@@ -1,6 +1,5 @@
 ﻿module;
 
-#include "core/Log.hpp"
 #include <platform/windows/CRWindows.h>
 
 module CR.Engine.Platform.MemoryMappedFile;
@@ -18,26 +17,39 @@ namespace cep = CR::Engine::Platform;
 
 cep::MemoryMappedFile::MemoryMappedFile() {}
 
-cep::MemoryMappedFile::MemoryMappedFile(const std::filesystem::path& a_filePath) {
-	auto handle = CreateFileW(a_filePath.c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING,
-	                          FILE_ATTRIBUTE_NORMAL, 0);
-	CR_ASSERT(handle != INVALID_HANDLE_VALUE, "Could not open file {}", a_filePath.string());
+cep::MemoryMappedFile::MemoryMappedFile(const std::filesystem::path& a_filePath, bool a_populate) {
+	// the view is read only, so others reading the file at the same time is fine. PrefetchFile and
+	// EvictFile briefly open sources that a worker may be mapping.
+	auto handle = CreateFileW(a_filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(handle == INVALID_HANDLE_VALUE) { return; }
 
+	// CreateFileMapping fails on an empty file anyway.
 	LARGE_INTEGER fileSize;
-	if(!GetFileSizeEx(handle, &fileSize)) {
-		CR_ASSERT(false, "Could not get file size for {}", a_filePath.string());
+	if(!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(handle);
+		return;
+	}
+	// returns null on failure, not INVALID_HANDLE_VALUE.
+	HANDLE mapping = CreateFileMapping(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mapping == nullptr) {
+		CloseHandle(handle);
+		return;
+	}
+	auto data = (std::byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return;
 	}
-	CR_ASSERT(fileSize.QuadPart != 0, "File {} was 0 sized", a_filePath.string());
 
-	m_fileData               = std::make_unique<MemoryMappedFileData>();
-	m_fileData->m_fileHandle = handle;
-	m_fileData->m_fileSize   = fileSize.QuadPart;
+	m_fileData                = std::make_unique<MemoryMappedFileData>();
+	m_fileData->m_fileHandle  = handle;
+	m_fileData->m_fileMapping = mapping;
+	m_fileData->m_data        = data;
+	m_fileData->m_fileSize    = fileSize.QuadPart;
 
-	m_fileData->m_fileMapping =
-	    CreateFileMapping(m_fileData->m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
-	CR_ASSERT(m_fileData->m_fileMapping != INVALID_HANDLE_VALUE, "Could not map file {}",
-	          a_filePath.string());
-	m_fileData->m_data = (std::byte*)MapViewOfFile(m_fileData->m_fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if(a_populate) { Prefetch(0, m_fileData->m_fileSize); }
 }
 
 cep::MemoryMappedFile::~MemoryMappedFile() {
@@ -72,3 +84,26 @@ const std::byte* cep::MemoryMappedFile::data() const noexcept {
 	if(!m_fileData) { return nullptr; }
 	return m_fileData->m_data;
 }
+
+void cep::MemoryMappedFile::SetAccessHint(AccessHint) {}
+
+void cep::MemoryMappedFile::Prefetch(std::size_t a_offset, std::size_t a_size) {
+	if(!m_fileData || a_offset >= m_fileData->m_fileSize) { return; }
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = m_fileData->m_data + a_offset;
+	range.NumberOfBytes  = std::min(a_size, m_fileData->m_fileSize - a_offset);
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void cep::MemoryMappedFile::Release(std::size_t a_offset, std::size_t a_size) {
+	if(!m_fileData || a_offset >= m_fileData->m_fileSize) { return; }
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	const std::size_t pageSize = systemInfo.dwPageSize;
+	const std::size_t start    = (a_offset + pageSize - 1) / pageSize * pageSize;
+	const std::size_t end = std::min(a_offset + a_size, m_fileData->m_fileSize) / pageSize * pageSize;
+	if(start >= end) { return; }
+	// VirtualUnlock on pages that aren't locked takes them out of the working set, and fails with
+	// ERROR_NOT_LOCKED while doing it. They stay in the standby list.
+	VirtualUnlock(m_fileData->m_data + start, end - start);
+}
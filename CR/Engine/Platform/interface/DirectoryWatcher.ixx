@@ -0,0 +1,31 @@
+export module CR.Engine.Platform.DirectoryWatcher;
+
+import std;
+
+namespace CR::Engine::Platform {
+	// Watches a directory and everything under it for files and folders being created, written,
+	// touched, deleted or renamed. inotify on linux, ReadDirectoryChangesW on windows. inotify needs
+	// a watch per folder, those are added on a background thread, so changes in a big tree may not
+	// be seen for a moment after it is created or moved in. The folder itself is always reported.
+	export class DirectoryWatcher final {
+	public:
+		DirectoryWatcher();
+		DirectoryWatcher(const std::filesystem::path& a_root);
+		~DirectoryWatcher();
+		DirectoryWatcher(const DirectoryWatcher&) = delete;
+		DirectoryWatcher(DirectoryWatcher&& a_other) noexcept;
+		DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+		DirectoryWatcher& operator=(DirectoryWatcher&& a_other) noexcept;
+
+		// Appends the path, relative to the root, of everything that changed since the last call.
+		// Never blocks. A path can show up more than once, and a folder showing up means anything
+		// under it may have changed too. Returns false if the OS dropped events, then anywhere in the
+		// tree could have changed.
+		[[nodiscard]] bool Poll(std::vector<std::filesystem::path>& a_changed);
+
+		[[nodiscard]] bool isValid() const { return m_watchData.get() != nullptr; }
+
+	private:
+		std::unique_ptr<struct DirectoryWatcherData> m_watchData;
+	};
+}    // namespace CR::Engine::Platform
@@ -0,0 +1,12 @@
+export module CR.Engine.Platform.FileCopy;
+
+import std;
+
+export namespace CR::Engine::Platform {
+	// Copies a_from to a_to, replacing a_to if it is already there. If both are on a filesystem that
+	// can share data between files the copy is a clone, nothing is read or written (FICLONE on linux,
+	// block cloning on windows). Otherwise the kernel copies the data, it never comes through this
+	// process. False with a_error set if it failed, a_to may then be left partly written.
+	[[nodiscard]] bool CloneOrCopyFile(const std::filesystem::path& a_from,
+	                                   const std::filesystem::path& a_to, std::error_code& a_error);
+}    // namespace CR::Engine::Platform
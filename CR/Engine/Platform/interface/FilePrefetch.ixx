@@ -0,0 +1,15 @@
+export module CR.Engine.Platform.FilePrefetch;
+
+import std;
+
+export namespace CR::Engine::Platform {
+	// Starts reading all of a_path into the OS file cache and returns without waiting for it, so a
+	// later read or mapping of it doesn't have to wait on the disk (posix_fadvise on linux,
+	// PrefetchVirtualMemory on windows). Only a hint, false if the file couldn't be opened, but even
+	// on success the OS may read less than all of it or drop it again before it is used.
+	bool PrefetchFile(const std::filesystem::path& a_path);
+	// The opposite, drops what the OS file cache has of a_path, for a file that won't be read again
+	// any time soon. Pages still mapped by anyone stay (posix_fadvise on linux, a non buffered open
+	// on windows which purges the file's cache). Only a hint, false if the file couldn't be opened.
+	bool EvictFile(const std::filesystem::path& a_path);
+}    // namespace CR::Engine::Platform
@@ -5,8 +5,21 @@ import std;
 namespace CR::Engine::Platform {
 	export class MemoryMappedFile final {
 	public:
+		// How the mapping is going to be read, so the OS can read ahead to suit.
+		enum class AccessHint {
+			Normal,
+			// front to back, read ahead further and don't keep pages once they have been passed.
+			Sequential,
+			// no read ahead, it would mostly be wasted.
+			Random,
+		};
+
 		MemoryMappedFile();
-		MemoryMappedFile(const std::filesystem::path& a_filePath);
+		// a_populate reads the whole file in before returning, for when all of it is needed straight
+		// away. Otherwise pages are read as they are first touched. If the file can't be opened or
+		// mapped, or is empty, there is nothing to map and the result isn't valid, data() is nullptr
+		// and size() is 0.
+		MemoryMappedFile(const std::filesystem::path& a_filePath, bool a_populate = false);
 		~MemoryMappedFile();
 		MemoryMappedFile(const MemoryMappedFile&) = delete;
 		MemoryMappedFile(MemoryMappedFile&& a_other) noexcept;
@@ -36,6 +49,17 @@ namespace CR::Engine::Platform {
 
 		[[nodiscard]] bool isValid() const { return m_fileData.get() != nullptr; }
 
+		// Only a hint, the OS may ignore it. madvise on linux, nothing on windows which has no
+		// equivalent for a view that is already mapped.
+		void SetAccessHint(AccessHint a_hint);
+		// Starts reading a_size bytes from a_offset in the background, so they are there by the time
+		// they are touched. Clamped to the file.
+		void Prefetch(std::size_t a_offset, std::size_t a_size);
+		// Lets go of the pages for a_size bytes from a_offset that are in memory, for a reader that is
+		// done with them. Still mapped, a later touch just reads them in again. Only whole pages
+		// inside the range are released, and it is clamped to the file.
+		void Release(std::size_t a_offset, std::size_t a_size);
+
 	private:
 		std::unique_ptr<struct MemoryMappedFileData> m_fileData;
 	};
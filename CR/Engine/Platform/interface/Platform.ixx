@@ -1,4 +1,7 @@
 export module CR.Engine.Platform;
 
+export import CR.Engine.Platform.DirectoryWatcher;
+export import CR.Engine.Platform.FileCopy;
+export import CR.Engine.Platform.FilePrefetch;
 export import CR.Engine.Platform.MemoryMappedFile;
 export import CR.Engine.Platform.PathUtils;
\ No newline at end of file
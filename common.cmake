@@ -44,7 +44,7 @@ function(addCommon target)
 	target_compile_options(${target} PRIVATE $<$<AND:$<CXX_COMPILER_ID:MSVC>,$<OR:$<CONFIG:RelWithDebInfo>,$<CONFIG:Profile>,$<CONFIG:Final>>>:/Oi>)
 	target_compile_options(${target} PRIVATE $<$<AND:$<CXX_COMPILER_ID:MSVC>,$<OR:$<CONFIG:RelWithDebInfo>,$<CONFIG:Profile>,$<CONFIG:Final>>>:/Ot>)
 	target_compile_options(${target} PRIVATE $<$<AND:$<CXX_COMPILER_ID:MSVC>,$<OR:$<CONFIG:RelWithDebInfo>,$<CONFIG:Profile>,$<CONFIG:Final>>>:/Ob2>)
-	target_compile_options(${target} PRIVATE /sdl-)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/sdl->)
 		
 	target_compile_definitions(${target} PRIVATE $<$<CONFIG:Debug>:CR_DEBUG=1>)
 	target_compile_definitions(${target} PRIVATE $<$<NOT:$<CONFIG:Debug>>:CR_DEBUG=0>)
@@ -78,8 +78,9 @@ function(settings3rdParty target)
 	source_group(TREE ${root} FILES ${CR_IMPLEMENTATION})
 	source_group(TREE ${root} FILES ${CR_BUILD_FILES})
 
-	target_compile_options(${target} PRIVATE /W0)
-	target_compile_options(${target} PRIVATE /WX-)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/W0>)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/WX->)
+	target_compile_options(${target} PRIVATE $<$<NOT:$<CXX_COMPILER_ID:MSVC>>:-w>)
 	
 	set_property(TARGET ${target} APPEND PROPERTY FOLDER 3rdParty)
 endfunction()
@@ -96,11 +97,13 @@ function(settingsCR target)
 	source_group(TREE ${root} FILES ${CR_IMPLEMENTATION})
 	source_group(TREE ${root} FILES ${CR_BUILD_FILES})
 		
-	target_compile_options(${target} PRIVATE /W4)
-	target_compile_options(${target} PRIVATE /WX)
-	target_compile_options(${target} PRIVATE /wd4324)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/W4>)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/WX>)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/wd4324>)
 	# because of fmt, it spams this warning
-	target_compile_options(${target} PRIVATE /wd4702)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:MSVC>:/wd4702>)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:GNU,Clang>:-Wall>)
+	target_compile_options(${target} PRIVATE $<$<CXX_COMPILER_ID:GNU,Clang>:-Wextra>)
 	
 	# Version can be packed into a single 32 bit int
 	# the max major version is 31. the max minor version is 255. patch can be up to 512K